@@ -1,5 +1,8 @@
 #include "agent.hpp"
 
+// The board is Init'd so boards can be assigned to it with setBoard
+Agent::Agent() { s.Init(); }
+
 bool Agent::getColor() { return color; }
 Shogi Agent::getBoard() { return s; }
 void Agent::setColor(bool c) {	color = c; }
@@ -11,6 +11,8 @@ class Agent {
 		Shogi getBoard();
 		void setColor(bool);
 	public:
+		Agent();
+
     // Virtual because eventually want to make another class allowing human to
     // interact via command line
 		virtual int getMove()=0;
@@ -0,0 +1,17 @@
+// Convert a json sample of training positions into the binary position format (see positions.hpp)
+//
+//      ./convert-positions ../json/train_data_5000.json ../json/train_data_5000.bin
+#include "positions.hpp"
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        cout << "Usage: " << argv[0] << " <in_file.json> <out_file.bin>" << endl;
+        return -1;
+    }
+
+    vector<PositionRecord> positions = positions_from_json(argv[1]);
+    save_positions(argv[2], positions);
+
+    cout << "Converted " << positions.size() << " positions to " << argv[2] << endl;
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "feature-cache.hpp"
+
+uint64_t FeatureCache::hash(const vector<unsigned char>& digest) {
+    // FNV-1a over the digest followed by a 64-bit finalizer to spread the low bits used for the slot
+    uint64_t h = 1469598103934665603ULL;
+    for (unsigned char byte : digest) {
+        h ^= byte;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h == 0 ? 1 : h;
+}
+
+void FeatureCache::reserve(size_t entries) {
+    // Keep the load factor at or below one half
+    size_t n_slots = 16;
+    while (n_slots < 2 * entries) n_slots *= 2;
+    if (n_slots > slots.size()) rehash(n_slots);
+
+    arena.reserve(entries * n_features);
+}
+
+void FeatureCache::clear() {
+    slots.clear();
+    arena.clear();
+    n_entries = 0;
+    hits = misses = collisions = 0;
+}
+
+size_t FeatureCache::probe(uint64_t key) {
+    size_t mask = slots.size() - 1;
+    size_t i = key & mask;
+    while (slots[i].key != 0 and slots[i].key != key) {
+        collisions++;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void FeatureCache::rehash(size_t n_slots) {
+    vector<Slot> old(n_slots, Slot{0, 0});
+    old.swap(slots);
+
+    // Probes while moving entries are not lookups, keep them out of the collision count
+    long long lookup_collisions = collisions;
+    for (const Slot& slot : old) {
+        if (slot.key != 0) slots[probe(slot.key)] = slot;
+    }
+    collisions = lookup_collisions;
+}
+
+const int* FeatureCache::find(uint64_t key) {
+    if (slots.empty()) {
+        misses++;
+        return nullptr;
+    }
+
+    const Slot& slot = slots[probe(key)];
+    if (slot.key == 0) {
+        misses++;
+        return nullptr;
+    }
+
+    hits++;
+    return &arena[(size_t)slot.entry * n_features];
+}
+
+const int* FeatureCache::insert(uint64_t key, const vector<int>& fV) {
+    if (fV.size() != n_features) {
+        throw invalid_argument("Expected fV to be size of N features");
+    }
+
+    // Grow before the table gets more than half full
+    if (2 * (n_entries + 1) > slots.size()) {
+        rehash(max((size_t)16, 2 * slots.size()));
+    }
+
+    Slot& slot = slots[probe(key)];
+    if (slot.key == 0) {
+        slot.key = key;
+        slot.entry = n_entries++;
+        arena.insert(arena.end(), fV.begin(), fV.end());
+    }
+
+    return &arena[(size_t)slot.entry * n_features];
+}
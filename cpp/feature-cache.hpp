@@ -0,0 +1,45 @@
+#pragma once
+#include "features.hpp"
+#include <cstdint>
+
+// Transposition table of raw feature vectors keyed by a 64-bit hash of the position digest
+// (Shogi::SaveGame). Open addressing with linear probing over a flat slot array, and the feature
+// vectors themselves are stored inline, one after another, in a single arena instead of one heap
+// allocation per entry. Only the hash is kept, two positions sharing a 64-bit hash share an entry.
+class FeatureCache {
+    public:
+        static constexpr int n_features = FeatureConfig::n_features;
+
+        static uint64_t hash(const vector<unsigned char>& digest);
+
+        // Make room for at least this many entries without rehashing or growing the arena
+        void reserve(size_t entries);
+        void clear();
+
+        // Feature vector stored for the key, nullptr if the position has not been seen
+        const int* find(uint64_t key);
+        const int* insert(uint64_t key, const vector<int>& fV);
+
+        size_t size() const { return n_entries; }
+        size_t capacity() const { return slots.size(); }
+
+        // Lookups that found / did not find their key, and extra probes caused by occupied slots
+        long long get_hits() const { return hits; }
+        long long get_misses() const { return misses; }
+        long long get_collisions() const { return collisions; }
+
+    private:
+        // Key 0 marks an empty slot, hash() never returns it
+        struct Slot {
+            uint64_t key;
+            uint32_t entry;
+        };
+        vector<Slot> slots;
+        vector<int> arena;
+        size_t n_entries = 0;
+
+        long long hits = 0, misses = 0, collisions = 0;
+
+        size_t probe(uint64_t key);
+        void rehash(size_t n_slots);
+};
@@ -0,0 +1,345 @@
+#include "feature-matrix.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char matrix_magic[8] = {'G', 'S', 'F', 'M', 'A', 'T', 'R', 'X'};
+
+void FeatureMatrix::clear() {
+    unmap();
+    values.clear();
+    moves.clear();
+    segments = {0};
+    gm_moves.clear();
+    gm_indices.clear();
+    sample_indices.clear();
+    point_at_vectors();
+}
+
+void FeatureMatrix::point_at_vectors() {
+    data.values = values.data();
+    data.moves = moves.data();
+    data.segments = segments.data();
+    data.gm_moves = gm_moves.data();
+    data.gm_indices = gm_indices.data();
+    data.sample_indices = sample_indices.data();
+    data.n_positions = gm_moves.size();
+    data.n_rows = moves.size();
+}
+
+void FeatureMatrix::unmap() {
+    if (mapping) {
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+        mapping_size = 0;
+    }
+}
+
+void FeatureMatrix::materialize() {
+    if (!mapping) return;
+
+    int n_positions = data.n_positions, n_rows = data.n_rows;
+    values.assign(data.values, data.values + (size_t)n_rows * n_features);
+    moves.assign(data.moves, data.moves + n_rows);
+    segments.assign(data.segments, data.segments + n_positions + 1);
+    gm_moves.assign(data.gm_moves, data.gm_moves + n_positions);
+    gm_indices.assign(data.gm_indices, data.gm_indices + n_positions);
+    sample_indices.assign(data.sample_indices, data.sample_indices + n_positions);
+
+    unmap();
+    point_at_vectors();
+}
+
+bool FeatureMatrix::save(const string& path, uint64_t key, int scanned) const {
+    FileHeader header;
+    memcpy(header.magic, matrix_magic, sizeof(header.magic));
+    header.version = file_version;
+    header.n_features = n_features;
+    header.key = key;
+    header.n_positions = data.n_positions;
+    header.n_rows = data.n_rows;
+    header.scanned = scanned;
+    header.reserved = 0;
+
+    // Readers only ever see a complete file, rename replaces the old one atomically
+    string tmp_path = path + ".tmp." + to_string(getpid());
+    FILE* out = fopen(tmp_path.c_str(), "wb");
+    if (!out) return false;
+
+    int n_positions = data.n_positions, n_rows = data.n_rows;
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = ok and fwrite(data.segments, sizeof(int), n_positions + 1, out) == (size_t)n_positions + 1;
+    ok = ok and fwrite(data.gm_moves, sizeof(int), n_positions, out) == (size_t)n_positions;
+    ok = ok and fwrite(data.gm_indices, sizeof(int), n_positions, out) == (size_t)n_positions;
+    ok = ok and fwrite(data.sample_indices, sizeof(int), n_positions, out) == (size_t)n_positions;
+    ok = ok and fwrite(data.moves, sizeof(int), n_rows, out) == (size_t)n_rows;
+    ok = ok and fwrite(data.values, sizeof(int16_t), (size_t)n_rows * n_features, out) == (size_t)n_rows * n_features;
+    ok = (fclose(out) == 0) and ok;
+
+    if (!ok or rename(tmp_path.c_str(), path.c_str()) != 0) {
+        remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool FeatureMatrix::load(const string& path, uint64_t key, int& scanned) {
+    return map_file(path, key, scanned, true);
+}
+
+bool FeatureMatrix::attach(const string& path, uint64_t& key, int& scanned) {
+    if (!map_file(path, key, scanned, false)) return false;
+    key = ((const FileHeader*)mapping)->key;
+    return true;
+}
+
+bool FeatureMatrix::map_file(const string& path, uint64_t key, int& scanned, bool check_key) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 or (size_t)st.st_size < sizeof(FileHeader)) {
+        close(fd);
+        return false;
+    }
+
+    // Shared read-only mapping, every process using the same file shares the page cache
+    size_t size = st.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    const FileHeader* header = (const FileHeader*)map;
+    size_t n_positions = header->n_positions, n_rows = header->n_rows;
+    size_t expected = sizeof(FileHeader) + sizeof(int) * (4 * n_positions + 1 + n_rows)
+                      + sizeof(int16_t) * n_rows * n_features;
+
+    if (memcmp(header->magic, matrix_magic, sizeof(matrix_magic)) != 0 or header->version != file_version
+            or header->n_features != n_features or (check_key and header->key != key)
+            or header->n_positions < 0 or header->n_rows < 0 or size != expected) {
+        munmap(map, size);
+        return false;
+    }
+
+    clear();
+    mapping = map;
+    mapping_size = size;
+
+    const int* ints = (const int*)(header + 1);
+    data.segments = ints;
+    data.gm_moves = data.segments + n_positions + 1;
+    data.gm_indices = data.gm_moves + n_positions;
+    data.sample_indices = data.gm_indices + n_positions;
+    data.moves = data.sample_indices + n_positions;
+    data.values = (const int16_t*)(data.moves + n_rows);
+    data.n_positions = n_positions;
+    data.n_rows = n_rows;
+
+    scanned = header->scanned;
+    return true;
+}
+
+void FeatureMatrix::add_position(int sample_index, int gm_move, const vector<int>& moves,
+                                 const vector<vector<int>>& rows) {
+    if (moves.size() != rows.size()) {
+        throw invalid_argument("Expected a feature vector for every successor move");
+    }
+    materialize();
+
+    int gm_index = -1;
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (rows[i].size() != n_features) {
+            throw invalid_argument("Expected feature vectors to be size of N features");
+        }
+
+        for (int value : rows[i]) {
+            if (value < INT16_MIN or value > INT16_MAX) {
+                throw out_of_range("Feature value " + to_string(value) + " does not fit in 16 bits");
+            }
+            values.push_back(value);
+        }
+
+        this->moves.push_back(moves[i]);
+        if (moves[i] == gm_move and gm_index == -1) {
+            gm_index = i;
+        }
+    }
+
+    segments.push_back(this->moves.size());
+    gm_moves.push_back(gm_move);
+    gm_indices.push_back(gm_index);
+    sample_indices.push_back(sample_index);
+    point_at_vectors();
+}
+
+int FeatureMatrix::select_row(const vector<int>& weights, int position, int* gm_rank) const {
+    // Trip count is a compile time constant so the compiler is free to fully unroll this loop
+    auto score_row = [&](int r) {
+        const int16_t* fV = row(r);
+        int score = 0;
+        for (int i = 0; i < n_features; i++) {
+            score += fV[i] * weights[i];
+        }
+        return score;
+    };
+
+    // The grandmaster row is scored up front, so every row selected before it can be counted in one sweep
+    int gm_row = -1, gm_score = 0, ahead = 0;
+    if (gm_rank and data.gm_indices[position] != -1) {
+        gm_row = data.segments[position] + data.gm_indices[position];
+        gm_score = score_row(gm_row);
+    }
+
+    int best_score = INT_MIN, best_row = -1;
+    for (int r = data.segments[position]; r < data.segments[position + 1]; r++) {
+        int score = score_row(r);
+
+        if (score > best_score) {
+            best_score = score;
+            best_row = r;
+        }
+        if (gm_row != -1 and (score > gm_score or (score == gm_score and r < gm_row))) {
+            ahead++;
+        }
+    }
+
+    if (gm_rank) {
+        *gm_rank = gm_row == -1 ? 0 : ahead + 1;
+    }
+    return best_row;
+}
+
+void FeatureMatrix::check_positions(const vector<int>& positions) const {
+    for (int p : positions) {
+        if (p < 0 or p >= num_positions()) {
+            throw out_of_range("Feature matrix only holds " + to_string(num_positions()) + " positions");
+        }
+    }
+}
+
+void FeatureMatrix::select_rows(const vector<vector<int>>& population, const vector<int>& positions,
+                                vector<vector<int>>& best) const {
+    select_population(population, positions, best, nullptr);
+}
+
+void FeatureMatrix::select_rows(const vector<vector<int>>& population, const vector<int>& positions,
+                                vector<vector<int>>& best, vector<vector<int>>& ranks) const {
+    select_population(population, positions, best, &ranks);
+}
+
+void FeatureMatrix::select_population(const vector<vector<int>>& population, const vector<int>& positions,
+                                      vector<vector<int>>& best, vector<vector<int>>* ranks) const {
+    check_positions(positions);
+
+    // Weights transposed to feature major order, so each feature value of a row is applied to every
+    // organism in one contiguous (vectorizable) sweep
+    int n_organisms = population.size();
+    vector<int> weights(n_features * n_organisms);
+    for (int o = 0; o < n_organisms; o++) {
+        if (population[o].size() != n_features) {
+            throw invalid_argument("Expected weights to be size of N features");
+        }
+        for (int i = 0; i < n_features; i++) {
+            weights[i * n_organisms + o] = population[o][i];
+        }
+    }
+
+    int n_positions = positions.size();
+    best.assign(n_organisms, vector<int>(n_positions, -1));
+    if (ranks) {
+        ranks->assign(n_organisms, vector<int>(n_positions, 0));
+    }
+
+    #pragma omp parallel
+    {
+        vector<int> scores(n_organisms);
+        vector<int> best_score(n_organisms);
+        vector<int> gm_score(n_organisms);
+        vector<int> ahead(n_organisms);
+
+        // Most features of a successor are zero, skip them entirely
+        auto score_row = [&](int r, vector<int>& out) {
+            const int16_t* fV = row(r);
+            fill(out.begin(), out.end(), 0);
+            for (int i = 0; i < n_features; i++) {
+                int value = fV[i];
+                if (value == 0) continue;
+                const int* w = &weights[i * n_organisms];
+                for (int o = 0; o < n_organisms; o++) {
+                    out[o] += value * w[o];
+                }
+            }
+        };
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < n_positions; i++) {
+            int p = positions[i];
+            fill(best_score.begin(), best_score.end(), INT_MIN);
+
+            int gm_row = -1;
+            if (ranks and data.gm_indices[p] != -1) {
+                gm_row = data.segments[p] + data.gm_indices[p];
+                score_row(gm_row, gm_score);
+                fill(ahead.begin(), ahead.end(), 0);
+            }
+
+            for (int r = data.segments[p]; r < data.segments[p + 1]; r++) {
+                score_row(r, scores);
+
+                for (int o = 0; o < n_organisms; o++) {
+                    if (scores[o] > best_score[o]) {
+                        best_score[o] = scores[o];
+                        best[o][i] = r;
+                    }
+                }
+
+                if (gm_row != -1) {
+                    for (int o = 0; o < n_organisms; o++) {
+                        ahead[o] += scores[o] > gm_score[o] or (scores[o] == gm_score[o] and r < gm_row);
+                    }
+                }
+            }
+
+            if (gm_row != -1) {
+                for (int o = 0; o < n_organisms; o++) {
+                    (*ranks)[o][i] = ahead[o] + 1;
+                }
+            }
+        }
+    }
+}
+
+void FeatureMatrix::select_rows(const vector<int>& weights, const vector<int>& positions, vector<int>& best) const {
+    if (weights.size() != n_features) {
+        throw invalid_argument("Expected weights to be size of N features");
+    }
+    check_positions(positions);
+
+    int n_positions = positions.size();
+    best.resize(n_positions);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n_positions; i++) {
+        best[i] = select_row(weights, positions[i]);
+    }
+}
+
+void FeatureMatrix::select_rows(const vector<int>& weights, const vector<int>& positions, vector<int>& best,
+                                vector<int>& ranks) const {
+    if (weights.size() != n_features) {
+        throw invalid_argument("Expected weights to be size of N features");
+    }
+    check_positions(positions);
+
+    int n_positions = positions.size();
+    best.resize(n_positions);
+    ranks.resize(n_positions);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n_positions; i++) {
+        best[i] = select_row(weights, positions[i], &ranks[i]);
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include "features.hpp"
+#include <cstdint>
+
+// Feature vectors of every legal successor of a set of training positions, stored row after row as int16
+// in one contiguous block. The rows of a single position form a segment, so scoring an organism is a
+// segmented matrix-vector product followed by an argmax over each segment, streaming memory linearly.
+// A matrix can be saved to a versioned binary file and later mapped back read-only with mmap, so every
+// process evaluating the same data shares one copy of the pages and skips feature extraction entirely.
+class FeatureMatrix {
+    public:
+        static constexpr int n_features = FeatureConfig::n_features;
+        static constexpr uint32_t file_version = 1;
+
+        FeatureMatrix() { point_at_vectors(); }
+        ~FeatureMatrix() { unmap(); }
+        FeatureMatrix(const FeatureMatrix&) = delete;
+        FeatureMatrix& operator=(const FeatureMatrix&) = delete;
+
+        void clear();
+
+        // Write the matrix to path (through a temporary file and rename), tagged with a key identifying
+        // the data it was built from and the number of sample positions scanned to build it
+        bool save(const string& path, uint64_t key, int scanned) const;
+
+        // Map a matrix saved with the same key, false if the file is missing, stale or corrupt
+        bool load(const string& path, uint64_t key, int& scanned);
+
+        // Map a matrix saved from any data, returning the key it was saved with
+        bool attach(const string& path, uint64_t& key, int& scanned);
+        bool is_mapped() const { return mapping != nullptr; }
+
+        // Append the successors of a position. moves[i] is the move that leads to the board with features rows[i]
+        void add_position(int sample_index, int gm_move, const vector<int>& moves, const vector<vector<int>>& rows);
+
+        // Row with the highest score in the segment of each of positions, or -1 for an empty segment.
+        // Ties go to the first row, matching the order legal moves are considered in OrganismEvaluator
+        void select_rows(const vector<int>& weights, const vector<int>& positions, vector<int>& best) const;
+        int select_row(const vector<int>& weights, int position, int* gm_rank = nullptr) const;
+
+        // Same selection that also ranks the grandmaster row among the successors while scoring them:
+        // 1 when it would be selected, 1 + the rows selected before it otherwise, 0 when it is missing
+        void select_rows(const vector<int>& weights, const vector<int>& positions, vector<int>& best,
+                         vector<int>& ranks) const;
+
+        // Same selection for a whole population at once, each row is read once and scored against every
+        // organism, best[organism][i] for positions[i]
+        void select_rows(const vector<vector<int>>& population, const vector<int>& positions,
+                         vector<vector<int>>& best) const;
+        void select_rows(const vector<vector<int>>& population, const vector<int>& positions,
+                         vector<vector<int>>& best, vector<vector<int>>& ranks) const;
+
+        int num_positions() const { return data.n_positions; }
+        int num_rows() const { return data.n_rows; }
+        int segment_begin(int position) const { return data.segments[position]; }
+        int segment_end(int position) const { return data.segments[position + 1]; }
+        const int16_t* row(int r) const { return &data.values[(size_t)r * n_features]; }
+        int move(int r) const { return data.moves[r]; }
+
+        // Move played by the grandmaster, and its row within the segment (-1 when not a legal successor)
+        int gm_move(int position) const { return data.gm_moves[position]; }
+        int gm_index(int position) const { return data.gm_indices[position]; }
+
+        // Index of the position in the sample it was built from
+        int sample_index(int position) const { return data.sample_indices[position]; }
+
+    private:
+        // Storage for a matrix built in memory with add_position
+        vector<int16_t> values;
+        vector<int> moves;
+
+        // Segment p spans rows [segments[p], segments[p + 1])
+        vector<int> segments = {0};
+        vector<int> gm_moves;
+        vector<int> gm_indices;
+        vector<int> sample_indices;
+
+        // Arrays actually read from, pointing either into the vectors above or into a mapped file
+        struct Arrays {
+            const int16_t* values;
+            const int* moves;
+            const int* segments;
+            const int* gm_moves;
+            const int* gm_indices;
+            const int* sample_indices;
+            int n_positions;
+            int n_rows;
+        } data;
+        void point_at_vectors();
+
+        // Fixed size header at the start of a saved matrix, followed by segments, gm_moves, gm_indices,
+        // sample_indices, moves and finally values
+        struct FileHeader {
+            char magic[8];
+            uint32_t version;
+            uint32_t n_features;
+            uint64_t key;
+            int32_t n_positions;
+            int32_t n_rows;
+            int32_t scanned;
+            int32_t reserved;
+        };
+
+        void check_positions(const vector<int>& positions) const;
+        void select_population(const vector<vector<int>>& population, const vector<int>& positions,
+                               vector<vector<int>>& best, vector<vector<int>>* ranks) const;
+
+        void* mapping = nullptr;
+        size_t mapping_size = 0;
+        void unmap();
+        bool map_file(const string& path, uint64_t key, int& scanned, bool check_key);
+
+        // Copy a mapped matrix into the vectors so more positions can be appended
+        void materialize();
+};
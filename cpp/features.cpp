@@ -8,6 +8,7 @@ ShogiFeatures::ShogiFeatures(int player, vector<int> weights) : ShogiFeatures(pl
         throw invalid_argument(error);
     }
     this->weights = weights;
+    init_tier_margins();
 };
 
 ShogiFeatures::ShogiFeatures(int player) {
@@ -153,39 +154,118 @@ ShogiFeatures::ShogiFeatures(int player) {
 
     CASTLE_THRESHOLD = 100;
 
-    n_major_features = 0;
-
-    king_dist_diff = false;
-
-    pawn_count = 0;
     pawn_index = 0;
     pawn_value = 100;
-    group_promotions = false;
-    in_hand_bonus = true;
-    link_material = true;
 
     // Default initialize the feature vector
+    n_major_added = 0;
+    feature_links.fill(-1);
     init_features();
 
-    n_features = features.size();
+    // Guard against FeatureConfig falling out of sync with init_features
+    if (feature_order.size() != n_features or n_major_added != n_major_features) {
+        string error = "FeatureConfig expects " + to_string(n_features) + " features, but ";
+        error += to_string(feature_order.size()) + " were initialized";
+        throw logic_error(error);
+    }
+
+    init_tiers();
+    init_bounds();
+    tier_margins.fill(0);
+}
+
+void ShogiFeatures::init_tiers() {
+    // Every feature function sets all of its features unconditionally, so running each one on the
+    // initial board shows which features it owns
+    Shogi s;
+    s.Init();
+    s.FetchMove(1);
+
+    FeatureScratch f;
+    reset_scratch(player, f);
+    feature_tiers.fill(-1);
+    for (auto& entry : feature_functions) {
+        f.features.fill(INT_MIN);
+        (this->*entry.function)(s, f);
+        for (int i = 0; i < n_features; i++) {
+            if (f.features[i] != INT_MIN) feature_tiers[i] = entry.tier;
+        }
+    }
+
+    for (int i = 0; i < n_features; i++) {
+        if (feature_tiers[i] == -1) {
+            throw logic_error("Feature " + feature_order[i] + " is not set by any feature function");
+        }
+    }
+}
+
+void ShogiFeatures::init_bounds() {
+    // Conservative limits on the absolute value of each positional feature. Attack counts assume at most
+    // 40 pieces attacking a square and 20 squares attacked by a single piece
+    const map<string, int> bounds = {
+        {"PLAYER_KING_THREAT_PENALTY", 9 * 40}, {"BISHOP_MOBILITY", 2 * 81}, {"ROOK_MOBILITY", 2 * 81},
+        {"ENEMY_KING_ATTACKS", 9 * 40}, {"BISHOP_HEAD_PROTECTED", 2 * 40}, {"BISHOP_HEAD_ATTACK", 2 * 40},
+        {"PLAYER_KING_DEFENDERS", 9 * 40}, {"PLAYER_KING_ESCAPE_ROUTES", 9}, {"IN_CAMP_VULNERABILITY_PENALTY", 27},
+        {"OUT_CAMP_ATTACK", 27}, {"CASTLE_FORMATION", 40}, {"GOLD_AHEAD_SILVER_PENALTY", 4},
+        {"GOLD_ADJACENT_ROOK_PENALTY", 2 * 4}, {"BOXED_IN_BISHOP_PENALTY", 4}, {"PIECE_AHEAD_OF_PAWN_PENALTY", 18},
+        {"RECLINING_SILVER", 4}, {"CLAIMED_FILES", 9}, {"ADJACENT_SILVERS", 4}, {"ADJACENT_GOLDS", 4},
+        {"ROOK_ENEMY_CAMP", 2}, {"ROOK_ATTACK_KING_FILE", 2}, {"ROOK_ATTACK_KING_ADJ_FILE", 2},
+        {"ROOK_ATTACK_KING_ADJ_FILE_9821", 2}, {"ROOK_OPEN_FILE", 2}, {"ROOK_SEMI_OPEN_FILE", 2},
+        {"BLOCKED_FLOW_SAFE", 40}, {"AGGRESSION_BALANCE", 40}, {"TOTAL_ATTACKING", 40 * 20}
+    };
+
+    // Distance between two squares is at most 12, summed over every piece of a type for the difference
+    const map<string, int> piece_limits = {
+        {"PAWN", 18}, {"LANCE", 4}, {"KNIGHT", 4}, {"SILVER", 4}, {"GOLD", 4}, {"BISHOP", 2}, {"ROOK", 2}
+    };
+    const int max_distance = 12;
+
+    for (int i = 0; i < n_features; i++) {
+        const string& name = feature_order[i];
+        if (feature_tiers[i] == 0) {
+            // Material is always evaluated exactly
+            feature_bounds[i] = 0;
+        } else if (bounds.count(name)) {
+            feature_bounds[i] = bounds.at(name);
+        } else if (name.find("DTK_DIFF_") == 0) {
+            string piece = name.substr(name.rfind("_") + 1);
+            feature_bounds[i] = max_distance * piece_limits.at(piece);
+        } else if (name.find("DTK_") == 0) {
+            feature_bounds[i] = max_distance;
+        } else {
+            throw logic_error("No bound given for feature " + name);
+        }
+    }
+}
+
+void ShogiFeatures::init_tier_margins() {
+    // Positional features are never linked so their weighted contribution is just weight * value
+    for (int t = 0; t < n_tiers; t++) {
+        tier_margins[t] = 0;
+        for (int i = 0; i < n_features; i++) {
+            if (feature_tiers[i] > t) {
+                tier_margins[t] += abs(weights[i]) * feature_bounds[i];
+            }
+        }
+    }
 }
 
 
 void ShogiFeatures::add_feature(string name, bool major, string link="") {
-    features[name] = 0;
-    n_major_features += major ? 1 : 0;
+    int index = feature_order.size();
+    feature_index[name] = index;
+    n_major_added += major ? 1 : 0;
     feature_order.push_back(name);
 
     // Link the feature to the other
-    if (!link.empty()) {
+    if (!link.empty() and link_material) {
         if (link == "PAWN_VALUE") {
             /* feature_links[name] = -1; */
         } else {
             // Otherwise add the link to the other feature
             auto itr = find(feature_order.begin(), feature_order.end(), link);
             if (itr != feature_order.end()) {
-                int index = std::distance(feature_order.begin(), itr);
-                feature_links[name] = index;
+                feature_links[index] = std::distance(feature_order.begin(), itr);
             } else {
                 string error = "Cannot link " + link + ": does not exist";
                 throw invalid_argument(error);
@@ -224,7 +304,7 @@ void ShogiFeatures::init_features() {
         add_feature("SILVER_IN_HAND_BONUS", true, "SILVER_VALUE");
         add_feature("BISHOP_IN_HAND_BONUS", true, "BISHOP_VALUE");
         add_feature("ROOK_IN_HAND_BONUS", true, "ROOK_VALUE");
-        add_feature("GOLD_IN_HAND_BONUS", true, "GOLD_VALUE");
+        add_feature("GOLD_IN_HAND_BONUS", true, group_promotions ? "GOLD_AND_EQV_VALUE" : "GOLD_VALUE");
     } else {
         add_feature("PIECES_IN_HAND", false);
     }
@@ -308,58 +388,135 @@ void ShogiFeatures::init_features() {
     }
 }
 
-void ShogiFeatures::load_features(Shogi& s) {
-    // Individual feature calculations
-    material(s);
-    material_in_hand(s);
-    king_safety(s);
-    controlled_squares(s);
-    castle(s);
-    gold_ahead_silver_penalty(s);
-    gold_adjacent_rook_penalty(s);
-    boxed_in_bishop_penalty(s);
-    piece_ahead_of_pawns_penalty(s);
-    bishop_heads(s);
-    reclining_silver(s);
-    claimed_files(s);
-    adjacent_silvers(s);
-    adjacent_golds(s);
-    bishop_mobility(s);
-    rook_mobility(s);
-    rook_enemy_camp(s);
-    rook_attack_king_file(s);
-    rook_attack_king_adj_file(s);
-    rook_attack_king_adj_file_9821(s);
-    rook_open_semi_open_file(s);
-    blocked_flow(s);
-    aggression_balance(s);
-    king_attack(s);
-    total_attacking(s);
-    distance_to_kings(s);
+// Individual feature calculations, material must come first since it fills the piece position cache.
+// Total pieces in hand (used without in_hand_bonus) only counts the player's pieces so is not antisymmetric.
+// Castle parses every castle formation on each call so it is left to the last tier
+const vector<ShogiFeatures::FeatureFunctionEntry> ShogiFeatures::feature_functions = {
+    {"material", &ShogiFeatures::material, true, 0},
+    {"material_in_hand", &ShogiFeatures::material_in_hand, in_hand_bonus, 0},
+    {"king_safety", &ShogiFeatures::king_safety, false, 1},
+    {"controlled_squares", &ShogiFeatures::controlled_squares, false, 1},
+    {"castle", &ShogiFeatures::castle, false, 2},
+    {"gold_ahead_silver_penalty", &ShogiFeatures::gold_ahead_silver_penalty, false, 1},
+    {"gold_adjacent_rook_penalty", &ShogiFeatures::gold_adjacent_rook_penalty, false, 1},
+    {"boxed_in_bishop_penalty", &ShogiFeatures::boxed_in_bishop_penalty, false, 1},
+    {"piece_ahead_of_pawns_penalty", &ShogiFeatures::piece_ahead_of_pawns_penalty, false, 1},
+    {"bishop_heads", &ShogiFeatures::bishop_heads, false, 1},
+    {"reclining_silver", &ShogiFeatures::reclining_silver, false, 1},
+    {"claimed_files", &ShogiFeatures::claimed_files, false, 1},
+    {"adjacent_silvers", &ShogiFeatures::adjacent_silvers, false, 1},
+    {"adjacent_golds", &ShogiFeatures::adjacent_golds, false, 1},
+    {"bishop_mobility", &ShogiFeatures::bishop_mobility, false, 1},
+    {"rook_mobility", &ShogiFeatures::rook_mobility, false, 1},
+    {"rook_enemy_camp", &ShogiFeatures::rook_enemy_camp, false, 1},
+    {"rook_attack_king_file", &ShogiFeatures::rook_attack_king_file, false, 1},
+    {"rook_attack_king_adj_file", &ShogiFeatures::rook_attack_king_adj_file, false, 1},
+    {"rook_attack_king_adj_file_9821", &ShogiFeatures::rook_attack_king_adj_file_9821, false, 1},
+    {"rook_open_semi_open_file", &ShogiFeatures::rook_open_semi_open_file, false, 1},
+    {"blocked_flow", &ShogiFeatures::blocked_flow, false, 1},
+    {"aggression_balance", &ShogiFeatures::aggression_balance, true, 1},
+    {"king_attack", &ShogiFeatures::king_attack, false, 1},
+    {"total_attacking", &ShogiFeatures::total_attacking, false, 1},
+    {"distance_to_kings", &ShogiFeatures::distance_to_kings, false, 1},
+};
+
+void ShogiFeatures::load_features(Shogi& s, FeatureScratch& f) const {
+    // Time each feature function individually when a profile is attached to the scratch buffer
+    ProfileTimer timer(f.profile);
+    for (size_t i = 0; i < feature_functions.size(); i++) {
+        (this->*feature_functions[i].function)(s, f);
+        timer.lap(i);
+    }
 }
 
-vector<int> ShogiFeatures::generate_feature_vec_raw(Shogi s) {
+vector<string> ShogiFeatures::profile_labels() const {
+    vector<string> labels;
+    for (auto& entry : feature_functions) {
+        labels.push_back(entry.name);
+    }
+    return labels;
+}
+
+void FeatureProfile::merge(const FeatureProfile& other) {
+    if (nanos.size() < other.nanos.size()) {
+        nanos.resize(other.nanos.size(), 0);
+        calls.resize(other.calls.size(), 0);
+    }
+    for (size_t i = 0; i < other.nanos.size(); i++) {
+        nanos[i] += other.nanos[i];
+        calls[i] += other.calls[i];
+    }
+}
+
+void ShogiFeatures::reset_scratch(int perspective, FeatureScratch& f) const {
     // Set / Reset feature vector and pawn count to 0
-    pawn_count = 0;
+    f.player = perspective;
+    f.pawn_count = 0;
+    f.features.fill(0);
 
     // Initialize position cache
-    for (string piece : piece_strings) {
-        piece_pos[piece].first = {};
-        piece_pos[piece].second = {};
+    for (const string& piece : piece_strings) {
+        f.piece_pos[piece].first.clear();
+        f.piece_pos[piece].second.clear();
+    }
+}
+
+vector<int> ShogiFeatures::feature_vec_raw(Shogi& s, int perspective, FeatureScratch& f) const {
+    reset_scratch(perspective, f);
+
+    // Calcualte all feature values and save them to the scratch feature vector
+    load_features(s, f);
+
+    return vector<int>(f.features.begin(), f.features.end());
+}
+
+pair<vector<int>, vector<int>> ShogiFeatures::feature_vecs_raw(Shogi& s, FeatureScratch& sente,
+                                                                FeatureScratch& gote) const {
+    reset_scratch(SENTE, sente);
+    reset_scratch(GOTE, gote);
+
+    // Antisymmetric features first, calculated once from sente's perspective. Every other feature
+    // is still zero at this point so negating the whole vector only affects the mirrored values
+    ProfileTimer timer(sente.profile);
+    for (size_t i = 0; i < feature_functions.size(); i++) {
+        if (feature_functions[i].antisymmetric) {
+            (this->*feature_functions[i].function)(s, sente);
+            timer.lap(i);
+        }
+    }
+    for (int i = 0; i < n_features; i++) {
+        gote.features[i] = -sente.features[i];
+    }
+
+    // Gote's piece position cache is sente's with player and opponent swapped
+    for (auto& entry : sente.piece_pos) {
+        gote.piece_pos[entry.first] = {entry.second.second, entry.second.first};
     }
 
-    // Calcualte all feature values and save them to internal featues map
-    load_features(s);
+    // Remaining features depend on the perspective but share the board and attack maps
+    for (size_t i = 0; i < feature_functions.size(); i++) {
+        if (!feature_functions[i].antisymmetric) {
+            (this->*feature_functions[i].function)(s, sente);
+            timer.lap(i);
+            (this->*feature_functions[i].function)(s, gote);
+            timer.lap(i);
+        }
+    }
 
-    vector<int> feature_vec;
-    for (auto& name : feature_order) {
-        feature_vec.push_back(features[name]);
+    return {vector<int>(sente.features.begin(), sente.features.end()),
+            vector<int>(gote.features.begin(), gote.features.end())};
+}
+
+void ShogiFeatures::set_feature(FeatureScratch& f, const string& name, int value) const {
+    // Features that are not part of the current configuration are silently dropped
+    auto itr = feature_index.find(name);
+    if (itr != feature_index.end()) {
+        f.features[itr->second] = value;
     }
-    return feature_vec;
 }
 
-int ShogiFeatures::evaluate_feature_vec(vector<int>& fV, vector<int>& weights) {
-    if (fV.size() > n_features or weights.size() > n_features or fV.size() != weights.size()) {
+int ShogiFeatures::evaluate_feature_vec(const vector<int>& fV, const vector<int>& weights) const {
+    if (fV.size() != n_features or weights.size() != n_features) {
         string error = "Expected fV and weights to be size of N features";
         throw invalid_argument(error);
     }
@@ -370,36 +527,83 @@ int ShogiFeatures::evaluate_feature_vec(vector<int>& fV, vector<int>& weights) {
     /*     score += fV[i] * weights[i]; */
     /* } */
 
+    // Trip count is a compile time constant so the compiler is free to fully unroll this loop
     int score = 0;
     for (int i = 0; i < n_features; i++) {
-        // See if the feature is linked to another weight
-        if (feature_links.count(feature_order[i])) {
-            int linked_index = feature_links[feature_order[i]];
-            /* int linked_weight = linked_index == -1 ? pawn_value : weights[linked_index]; */
-            int linked_weight = weights[linked_index];
-            score += fV[i] * (linked_weight + weights[i]);
-        } else {
-            score += fV[i] * weights[i];
-        }
+        // Linked features also carry the weight of the feature they are linked to
+        int linked_weight = feature_links[i] == -1 ? 0 : weights[feature_links[i]];
+        score += fV[i] * (linked_weight + weights[i]);
     }
 
     return score;
 }
 
+vector<int> ShogiFeatures::effective_weights(const vector<int>& weights) const {
+    if (weights.size() != n_features) {
+        throw invalid_argument("Expected weights to be size of N features");
+    }
+
+    vector<int> effective(weights);
+    for (int i = 0; i < n_features; i++) {
+        if (feature_links[i] != -1) effective[i] += weights[feature_links[i]];
+    }
+    return effective;
+}
+
 // Read evolution.py to see explenation of these features
 int ShogiFeatures::evaluate(Shogi s) {
     /* Evaluate the shogi position s from the perspective of root player (maximizer) */
 
     // Feature vector
-    vector<int> fV = generate_feature_vec_raw(s);
+    FeatureScratch f;
+    vector<int> fV = feature_vec_raw(s, player, f);
     return evaluate_feature_vec(fV, weights);
 }
 
+int ShogiFeatures::evaluate(Shogi& s, int alpha, int beta) {
+    // Margins and scores come from the weights, which only the weights constructor sets
+    if (weights.size() != n_features) {
+        throw invalid_argument("Expected weights to be size of N features");
+    }
+
+    FeatureScratch f;
+    reset_scratch(player, f);
+
+    int score = 0;
+    for (int t = 0; t < n_tiers; t++) {
+        // Attack maps are only needed past material, so they are not built for positions that exit early
+        if (t == 1) {
+            s.FetchMove(1);
+        }
+
+        for (auto& entry : feature_functions) {
+            if (entry.tier == t) {
+                (this->*entry.function)(s, f);
+            }
+        }
+
+        for (int i = 0; i < n_features; i++) {
+            if (feature_tiers[i] == t) {
+                int linked_weight = feature_links[i] == -1 ? 0 : weights[feature_links[i]];
+                score += f.features[i] * (linked_weight + weights[i]);
+            }
+        }
+
+        // Stop once the remaining tiers can not bring the score back inside the window
+        int margin = tier_margins[t];
+        if (score + margin <= alpha) return score + margin;
+        if (score - margin >= beta) return score - margin;
+    }
+
+    return score;
+}
+
 // VISUALLY CHECKED
-void ShogiFeatures::material(Shogi& s) {
+void ShogiFeatures::material(Shogi& s, FeatureScratch& f) const {
     // Counts the number of pieces the current player has and returns them in the
     //      order of piece_strings class variable with counts of pieces that count
     //      as gold at the end.
+    int player = f.player;
 
     // First val in pair is current player count, second is opponent piece count
     map<string, pair<int, int>> piece_counts = {
@@ -419,14 +623,14 @@ void ShogiFeatures::material(Shogi& s) {
         int upgrade = gomakindUP(piece_type);
 
         // Get string representation and add to appropriate count map and piece position cache
-        string piece = piece_map[{id, upgrade}];
         if (id != KING) {
+            string piece = piece_map.at({id, upgrade});
             if (gomakindChesser(piece_type) == player) {
                 piece_counts[piece].first++;
-                piece_pos[piece].first.push_back(s.gomaPos[i]);
+                f.piece_pos[piece].first.push_back(s.gomaPos[i]);
             } else {
                 piece_counts[piece].second++;
-                piece_pos[piece].second.push_back(s.gomaPos[i]);
+                f.piece_pos[piece].second.push_back(s.gomaPos[i]);
             }
         }
     }
@@ -447,26 +651,27 @@ void ShogiFeatures::material(Shogi& s) {
             gold_count += diff;
         } else {
             /* string name = piece_strings_to_full[piece] + "_VALUE"; */
-            string name = piece_strings_to_full[piece];
+            string name = piece_strings_to_full.at(piece);
             string type = name.substr(0, name.find("_"));
             name += type == "PROMOTED" ? "_BONUS" : "_VALUE";
 
-            features[name] = diff;
+            set_feature(f, name, diff);
         }
     }
 
     // Add diff in gold pieces if we are grouping
     if (group_promotions) {
         string name = "GOLD_AND_EQV_VALUE";
-        features[name] = gold_count;
+        set_feature(f, name, gold_count);
     }
 }
 
 // VISUALLY CHECKED
-void ShogiFeatures::king_safety(Shogi& s) {
+void ShogiFeatures::king_safety(Shogi& s, FeatureScratch& f) const {
     // NOTE : Maybe make return the ratio instead of raw cout (threats / defenders) etc
     // or (defenders / 8) or (defense / escape) or something else?
     // Set of features that represent the overall safety of the king
+    int player = f.player;
 
     // Get all of the valid squares surrounding the king
     int opponent = (player ^ 1);
@@ -502,24 +707,23 @@ void ShogiFeatures::king_safety(Shogi& s) {
     }
 
     // Add to our feature vector
-    features["PLAYER_KING_DEFENDERS"] = defenders;
-    features["PLAYER_KING_ESCAPE_ROUTES"] = escape_routes;
-    features["PLAYER_KING_THREAT_PENALTY"] = -1 * threats;
+    set_feature(f, "PLAYER_KING_DEFENDERS", defenders);
+    set_feature(f, "PLAYER_KING_ESCAPE_ROUTES", escape_routes);
+    set_feature(f, "PLAYER_KING_THREAT_PENALTY", -1 * threats);
 }
 
-void ShogiFeatures::material_in_hand(Shogi& s) {
+void ShogiFeatures::material_in_hand(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
 
     if (!in_hand_bonus) {
-        total_pieces_in_hand(s);
+        total_pieces_in_hand(s, f);
         return;
     }
 
     int opponent = player ^ 1;
 
-    vector<int> player_hand;
-    vector<int> oppnent_hand;
-    player_hand.reserve(in_hand_order.size());
-    oppnent_hand.reserve(in_hand_order.size());
+    int player_hand[8];
+    int oppnent_hand[8];
 
 
     // 0-7 are Sente piece in hand queues, 8-15 are Gote
@@ -533,13 +737,14 @@ void ShogiFeatures::material_in_hand(Shogi& s) {
     }
 
     for (size_t i = 0; i < in_hand_order.size(); i++) {
-        string name = piece_strings_to_full[in_hand_order[i]] + "_IN_HAND_BONUS";
-        features[name] = player_hand[i] - oppnent_hand[i];
+        string name = piece_strings_to_full.at(in_hand_order[i]) + "_IN_HAND_BONUS";
+        set_feature(f, name, player_hand[i] - oppnent_hand[i]);
     }
 }
 
 // VISUALLY CHECKED
-void ShogiFeatures::total_pieces_in_hand(Shogi& s) {
+void ShogiFeatures::total_pieces_in_hand(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
 
     // int player = (s.round & 1);
     int piece_cnt = 0;
@@ -550,18 +755,19 @@ void ShogiFeatures::total_pieces_in_hand(Shogi& s) {
         piece_cnt += s.gomaTable[I].size();
     }
 
-    features["PIECES_IN_HAND"] = piece_cnt;
+    set_feature(f, "PIECES_IN_HAND", piece_cnt);
 }
 
 // VISUALLY CHECKED
-void ShogiFeatures::controlled_squares(Shogi& s) {
+void ShogiFeatures::controlled_squares(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
 
     // Initialize opponent based on perspective of the heuristic
     int opponent = (player ^ 1);
 
     // Initialize the camps based on the player
-    vector<int>& home_camp = (player == SENTE) ? sente_camp : gote_camp;
-    vector<int>& oppn_camp = (player == SENTE) ? gote_camp  : sente_camp;
+    const vector<int>& home_camp = (player == SENTE) ? sente_camp : gote_camp;
+    const vector<int>& oppn_camp = (player == SENTE) ? gote_camp  : sente_camp;
 
     // Find "in-camp-vulnerability", num of squares in home camp that are more
     // attacked than defended
@@ -622,8 +828,8 @@ void ShogiFeatures::controlled_squares(Shogi& s) {
     }
 
     // Add results to the feature vector
-    features["IN_CAMP_VULNERABILITY_PENALTY"] = -1 * vulnerable;
-    features["OUT_CAMP_ATTACK"] = attacking;
+    set_feature(f, "IN_CAMP_VULNERABILITY_PENALTY", -1 * vulnerable);
+    set_feature(f, "OUT_CAMP_ATTACK", attacking);
 
     /* if (print and (attacking > 0 or vulnerable > 0)) { */
     /*   s.EasyBoardPrint(); */
@@ -638,9 +844,10 @@ void ShogiFeatures::controlled_squares(Shogi& s) {
 }
 
 // VISUALLY CHECKED
-void ShogiFeatures::castle(Shogi& s) {
+void ShogiFeatures::castle(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
 
-    map<string, string>& castles = (player == SENTE) ?
+    const map<string, string>& castles = (player == SENTE) ?
                                     black_castles : white_castles;
 
     int king_pos = (player == SENTE) ?
@@ -714,15 +921,16 @@ void ShogiFeatures::castle(Shogi& s) {
     /* } */
 
     // Add the number of matching pieces in the closest castle formation to feature vector
-    features["CASTLE_FORMATION"] =  closest_match;
+    set_feature(f, "CASTLE_FORMATION", closest_match);
 }
 
 // Penalty features for bad shape
-void ShogiFeatures::gold_ahead_silver_penalty(Shogi& s) {
+void ShogiFeatures::gold_ahead_silver_penalty(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
 
     // Check each of the player's silver pieces
     int count = 0;
-    for (int pos : piece_pos["s"].first) {
+    for (int pos : f.piece_pos["s"].first) {
 
         // Get piece above the silver
         vector<int> adjacent = find_adjacent(pos);
@@ -738,14 +946,15 @@ void ShogiFeatures::gold_ahead_silver_penalty(Shogi& s) {
         }
     }
 
-    features["GOLD_AHEAD_SILVER_PENALTY"] = -1 * count;
+    set_feature(f, "GOLD_AHEAD_SILVER_PENALTY", -1 * count);
 }
 
-void ShogiFeatures::gold_adjacent_rook_penalty(Shogi& s) {
+void ShogiFeatures::gold_adjacent_rook_penalty(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
 
     // Also check for promoted rooks
-    vector<int> all_rooks = piece_pos["r"].first;
-    all_rooks.insert(all_rooks.end(), piece_pos["+r"].first.begin(), piece_pos["+r"].first.end());
+    vector<int> all_rooks = f.piece_pos["r"].first;
+    all_rooks.insert(all_rooks.end(), f.piece_pos["+r"].first.begin(), f.piece_pos["+r"].first.end());
 
     int count = 0;
     for (int pos : all_rooks) {
@@ -764,14 +973,15 @@ void ShogiFeatures::gold_adjacent_rook_penalty(Shogi& s) {
       count += left_g + right_g + bot_g + top_g;
     }
 
-    features["GOLD_ADJACENT_ROOK_PENALTY"] = -1 * count;
+    set_feature(f, "GOLD_ADJACENT_ROOK_PENALTY", -1 * count);
 }
 
-void ShogiFeatures::boxed_in_bishop_penalty(Shogi& s) {
+void ShogiFeatures::boxed_in_bishop_penalty(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
 
     // Also check for promoted rooks
-    vector<int> all_bishops = piece_pos["b"].first;
-    all_bishops.insert(all_bishops.end(), piece_pos["+b"].first.begin(), piece_pos["+b"].first.end());
+    vector<int> all_bishops = f.piece_pos["b"].first;
+    all_bishops.insert(all_bishops.end(), f.piece_pos["+b"].first.begin(), f.piece_pos["+b"].first.end());
 
     int boxed_corners = 0;
     for (int pos : all_bishops) {
@@ -789,11 +999,12 @@ void ShogiFeatures::boxed_in_bishop_penalty(Shogi& s) {
         boxed_corners = top_l_corner + top_r_corner + bot_l_corner + bot_r_corner;
     }
 
-    features["BOXED_IN_BISHOP_PENALTY"] = -1 * boxed_corners;
+    set_feature(f, "BOXED_IN_BISHOP_PENALTY", -1 * boxed_corners);
 }
 
-void ShogiFeatures::piece_ahead_of_pawns_penalty(Shogi& s) {
-    vector<int> pawns = piece_pos["p"].first;
+void ShogiFeatures::piece_ahead_of_pawns_penalty(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
+    vector<int> pawns = f.piece_pos["p"].first;
 
     int ahead_of_pawn_count = 0;
     for (int pos : pawns) {
@@ -806,13 +1017,14 @@ void ShogiFeatures::piece_ahead_of_pawns_penalty(Shogi& s) {
         }
     }
 
-    features["PIECE_AHEAD_OF_PAWN_PENALTY"] = -1 * ahead_of_pawn_count;
+    set_feature(f, "PIECE_AHEAD_OF_PAWN_PENALTY", -1 * ahead_of_pawn_count);
 }
 
 // Features for GOOD shape
-void ShogiFeatures::bishop_heads(Shogi& s) {
+void ShogiFeatures::bishop_heads(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
     int opponent = player ^ 1;
-    vector<int> bishops = piece_pos["b"].first;
+    vector<int> bishops = f.piece_pos["b"].first;
 
     int heads_protected = 0;
     for (int pos : bishops) {
@@ -825,7 +1037,7 @@ void ShogiFeatures::bishop_heads(Shogi& s) {
     }
 
     int enemy_head_attack = 0;
-    vector<int> oppn_bishops = piece_pos["b"].second;
+    vector<int> oppn_bishops = f.piece_pos["b"].second;
     for (int pos : oppn_bishops) {
         vector<int> adj = find_adjacent(pos);
         if (adj[top] != -1) {
@@ -835,12 +1047,13 @@ void ShogiFeatures::bishop_heads(Shogi& s) {
         }
     }
 
-    features["BISHOP_HEAD_PROTECTED"] = heads_protected;
-    features["BISHOP_HEAD_ATTACK"] = enemy_head_attack;
+    set_feature(f, "BISHOP_HEAD_PROTECTED", heads_protected);
+    set_feature(f, "BISHOP_HEAD_ATTACK", enemy_head_attack);
 }
 
-void ShogiFeatures::reclining_silver(Shogi& s) {
-    vector<int> silvers = piece_pos["s"].first;
+void ShogiFeatures::reclining_silver(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
+    vector<int> silvers = f.piece_pos["s"].first;
 
     int reclining = 0;
     for (int pos : silvers) {
@@ -862,11 +1075,12 @@ void ShogiFeatures::reclining_silver(Shogi& s) {
     }
 
 
-    features["RECLINING_SILVER"] = reclining;
+    set_feature(f, "RECLINING_SILVER", reclining);
 }
 
-void ShogiFeatures::claimed_files(Shogi& s) {
-    vector<int> pawns = piece_pos["p"].first;
+void ShogiFeatures::claimed_files(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
+    vector<int> pawns = f.piece_pos["p"].first;
 
     int claimed = 0;
     for (int pos : fifth_rank) {
@@ -883,20 +1097,21 @@ void ShogiFeatures::claimed_files(Shogi& s) {
         }
     }
 
-    features["CLAIMED_FILES"] = claimed;
+    set_feature(f, "CLAIMED_FILES", claimed);
 }
 
-void ShogiFeatures::adjacent_silvers(Shogi& s) {
-    features["ADJACENT_SILVERS"] = count_adj_pairs("s", s);
+void ShogiFeatures::adjacent_silvers(Shogi& s, FeatureScratch& f) const {
+    set_feature(f, "ADJACENT_SILVERS", count_adj_pairs("s", s, f));
 }
 
-void ShogiFeatures::adjacent_golds(Shogi& s) {
-    features["ADJACENT_GOLDS"] = count_adj_pairs("g", s);
+void ShogiFeatures::adjacent_golds(Shogi& s, FeatureScratch& f) const {
+    set_feature(f, "ADJACENT_GOLDS", count_adj_pairs("g", s, f));
 }
 
-void ShogiFeatures::rook_enemy_camp(Shogi& s) {
-    vector<int> all_rooks = piece_pos["r"].first;
-    all_rooks.insert(all_rooks.end(), piece_pos["+r"].first.begin(), piece_pos["+r"].first.end());
+void ShogiFeatures::rook_enemy_camp(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
+    vector<int> all_rooks = f.piece_pos["r"].first;
+    all_rooks.insert(all_rooks.end(), f.piece_pos["+r"].first.begin(), f.piece_pos["+r"].first.end());
 
     int count = 0;
     for (int pos : all_rooks) {
@@ -905,12 +1120,13 @@ void ShogiFeatures::rook_enemy_camp(Shogi& s) {
         count += (player == GOTE and file > 6) ? 1 : 0;
     }
 
-    features["ROOK_ENEMY_CAMP"] = count;
+    set_feature(f, "ROOK_ENEMY_CAMP", count);
 }
 
-void ShogiFeatures::rook_attack_king_file(Shogi& s) {
-    vector<int> all_rooks = piece_pos["r"].first;
-    all_rooks.insert(all_rooks.end(), piece_pos["+r"].first.begin(), piece_pos["+r"].first.end());
+void ShogiFeatures::rook_attack_king_file(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
+    vector<int> all_rooks = f.piece_pos["r"].first;
+    all_rooks.insert(all_rooks.end(), f.piece_pos["+r"].first.begin(), f.piece_pos["+r"].first.end());
     int oppn_king = (player == SENTE) ? s.gomaPos[s.GOTEKINGNUM] : s.gomaPos[s.SENTEKINGNUM];
 
     int count = 0;
@@ -918,12 +1134,13 @@ void ShogiFeatures::rook_attack_king_file(Shogi& s) {
         count += posSuji(pos) == posSuji(oppn_king) ? 1 : 0;
     }
 
-    features["ROOK_ATTACK_KING_FILE"] = count;
+    set_feature(f, "ROOK_ATTACK_KING_FILE", count);
 }
 
-void ShogiFeatures::rook_attack_king_adj_file(Shogi& s) {
-    vector<int> all_rooks = piece_pos["r"].first;
-    all_rooks.insert(all_rooks.end(), piece_pos["+r"].first.begin(), piece_pos["+r"].first.end());
+void ShogiFeatures::rook_attack_king_adj_file(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
+    vector<int> all_rooks = f.piece_pos["r"].first;
+    all_rooks.insert(all_rooks.end(), f.piece_pos["+r"].first.begin(), f.piece_pos["+r"].first.end());
     int oppn_king = (player == SENTE) ? s.gomaPos[s.GOTEKINGNUM] : s.gomaPos[s.SENTEKINGNUM];
 
     int count = 0;
@@ -932,12 +1149,13 @@ void ShogiFeatures::rook_attack_king_adj_file(Shogi& s) {
         count += abs(diff) == 1 ? 1 : 0;
     }
 
-    features["ROOK_ATTACK_KING_ADJ_FILE"] = count;
+    set_feature(f, "ROOK_ATTACK_KING_ADJ_FILE", count);
 }
 
-void ShogiFeatures::rook_attack_king_adj_file_9821(Shogi& s) {
-    vector<int> all_rooks = piece_pos["r"].first;
-    all_rooks.insert(all_rooks.end(), piece_pos["+r"].first.begin(), piece_pos["+r"].first.end());
+void ShogiFeatures::rook_attack_king_adj_file_9821(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
+    vector<int> all_rooks = f.piece_pos["r"].first;
+    all_rooks.insert(all_rooks.end(), f.piece_pos["+r"].first.begin(), f.piece_pos["+r"].first.end());
     int oppn_king = (player == SENTE) ? s.gomaPos[s.GOTEKINGNUM] : s.gomaPos[s.SENTEKINGNUM];
     int king_suji = posSuji(oppn_king);
 
@@ -955,12 +1173,13 @@ void ShogiFeatures::rook_attack_king_adj_file_9821(Shogi& s) {
         }
     }
 
-    features["ROOK_ATTACK_KING_ADJ_FILE_9821"] = count;
+    set_feature(f, "ROOK_ATTACK_KING_ADJ_FILE_9821", count);
 }
 
-void ShogiFeatures::rook_open_semi_open_file(Shogi& s) {
-    vector<int> all_rooks = piece_pos["r"].first;
-    all_rooks.insert(all_rooks.end(), piece_pos["+r"].first.begin(), piece_pos["+r"].first.end());
+void ShogiFeatures::rook_open_semi_open_file(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
+    vector<int> all_rooks = f.piece_pos["r"].first;
+    all_rooks.insert(all_rooks.end(), f.piece_pos["+r"].first.begin(), f.piece_pos["+r"].first.end());
 
     int open_count = 0, semi_open = 0, owned = 0;
     for (int rook : all_rooks) {
@@ -984,24 +1203,25 @@ void ShogiFeatures::rook_open_semi_open_file(Shogi& s) {
         semi_open += (on_file == 1 and !owned) ? 1 : 0;
     }
 
-    features["ROOK_OPEN_FILE"] = open_count;
-    features["ROOK_SEMI_OPEN_FILE"] = semi_open;
+    set_feature(f, "ROOK_OPEN_FILE", open_count);
+    set_feature(f, "ROOK_SEMI_OPEN_FILE", semi_open);
 }
 
-void ShogiFeatures::bishop_mobility(Shogi& s) {
-    vector<int> squares = find_flow_moves("b", s);
-    int safe = count_safe_squares(squares, s);
-    features["BISHOP_MOBILITY"] = safe;
+void ShogiFeatures::bishop_mobility(Shogi& s, FeatureScratch& f) const {
+    vector<int> squares = find_flow_moves("b", s, f);
+    int safe = count_safe_squares(squares, s, f);
+    set_feature(f, "BISHOP_MOBILITY", safe);
 }
 
-void ShogiFeatures::rook_mobility(Shogi& s) {
-    vector<int> squares = find_flow_moves("r", s);
-    int safe = count_safe_squares(squares, s);
-    features["ROOK_MOBILITY"] = safe;
+void ShogiFeatures::rook_mobility(Shogi& s, FeatureScratch& f) const {
+    vector<int> squares = find_flow_moves("r", s, f);
+    int safe = count_safe_squares(squares, s, f);
+    set_feature(f, "ROOK_MOBILITY", safe);
 }
 
-void ShogiFeatures::blocked_flow(Shogi& s) {
+void ShogiFeatures::blocked_flow(Shogi& s, FeatureScratch& f) const {
     // Count how much of the opponent's flow player is blocking and is protected
+    int player = f.player;
 
     int opponent = player ^ 1;
 
@@ -1029,11 +1249,12 @@ void ShogiFeatures::blocked_flow(Shogi& s) {
         }
     }
 
-    features["BLOCKED_FLOW_SAFE"] = blocked;
+    set_feature(f, "BLOCKED_FLOW_SAFE", blocked);
 }
 
 
-void ShogiFeatures::aggression_balance(Shogi& s) {
+void ShogiFeatures::aggression_balance(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
     double sente_agro = 0;
     double gote_agro = 0;
     for (int i = 0; i < 40; i++) {
@@ -1046,11 +1267,12 @@ void ShogiFeatures::aggression_balance(Shogi& s) {
     }
 
     double score = player == SENTE ? (sente_agro - gote_agro) : (gote_agro - sente_agro);
-    features["AGGRESSION_BALANCE"] = (int)(score);
+    set_feature(f, "AGGRESSION_BALANCE", (int)(score));
 }
 
 
-void ShogiFeatures::king_attack(Shogi& s) {
+void ShogiFeatures::king_attack(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
     int opponent = (player ^ 1);
     int enemy_king = (player == SENTE) ?
                     s.gomaPos[s.GOTEKINGNUM] :
@@ -1093,11 +1315,12 @@ void ShogiFeatures::king_attack(Shogi& s) {
         }
     }
 
-    features["ENEMY_KING_ATTACKS"] = num_attacks;
-    features["ENEMY_KING_ATTACKS_SAFE"] = num_safe_attacks;
+    set_feature(f, "ENEMY_KING_ATTACKS", num_attacks);
+    set_feature(f, "ENEMY_KING_ATTACKS_SAFE", num_safe_attacks);
 }
 
-void ShogiFeatures::total_attacking(Shogi& s) {
+void ShogiFeatures::total_attacking(Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
     int opponent = (player ^ 1);
     int player_squares = 0, opponent_squares = 0;
     for (int pos = 0; pos < 81; pos++) {
@@ -1107,11 +1330,12 @@ void ShogiFeatures::total_attacking(Shogi& s) {
         opponent_squares += s.boardBFlowAttacking[opponent][pos].size();
     }
 
-    features["TOTAL_ATTACKING"] = player_squares - opponent_squares;
+    set_feature(f, "TOTAL_ATTACKING", player_squares - opponent_squares);
 }
 
-void ShogiFeatures::distance_to_kings(Shogi& s) {
+void ShogiFeatures::distance_to_kings(Shogi& s, FeatureScratch& f) const {
     // Measure the general distance each piece has to go to the enemy king
+    int player = f.player;
     int opponent = (player ^ 1);
     int player_king = (player == SENTE) ?
                     s.gomaPos[s.SENTEKINGNUM] :
@@ -1126,7 +1350,7 @@ void ShogiFeatures::distance_to_kings(Shogi& s) {
     map<string, int> distances_enemy;
 
     if (king_dist_diff) {
-        for (auto& positions : piece_pos) {
+        for (auto& positions : f.piece_pos) {
             string piece = positions.first;
             vector<int> player_pieces = positions.second.first;
             vector<int> oppn_pieces = positions.second.second;
@@ -1144,15 +1368,15 @@ void ShogiFeatures::distance_to_kings(Shogi& s) {
 
         // Add these features
         for (string piece : piece_strings) {
-            string name = "DTK_DIFF_" + piece_strings_to_full[piece];
-            features[name] = distances_diff[piece];
+            string name = "DTK_DIFF_" + piece_strings_to_full.at(piece);
+            set_feature(f, name, distances_diff[piece]);
         }
     }
 
     // Else have a weight for each of player's piece distance to thier own kng and enemy
     else {
         // Distance to player's own king
-        for (auto& positions : piece_pos) {
+        for (auto& positions : f.piece_pos) {
             string piece = positions.first;
             vector<int> player_pieces = positions.second.first;
             for (int pos : player_pieces) {
@@ -1164,10 +1388,10 @@ void ShogiFeatures::distance_to_kings(Shogi& s) {
 
         // Add these features
         for (string piece : piece_strings) {
-            string name_friendly = "DTK_FRIENDLY_" + piece_strings_to_full[piece];
-            string name_enemy = "DTK_ENEMY_" + piece_strings_to_full[piece];
-            features[name_friendly] = distances_friendly[piece];
-            features[name_enemy] = distances_friendly[piece];
+            string name_friendly = "DTK_FRIENDLY_" + piece_strings_to_full.at(piece);
+            string name_enemy = "DTK_ENEMY_" + piece_strings_to_full.at(piece);
+            set_feature(f, name_friendly, distances_friendly[piece]);
+            set_feature(f, name_enemy, distances_friendly[piece]);
         }
     }
 
@@ -1183,11 +1407,11 @@ void ShogiFeatures::distance_to_kings(Shogi& s) {
     /*     } */
     /* } */
 
-    /* features["DISTANCE_TO_KINGS"] = (player_dist - opponent_dist) * king_dist_discount; */
+    /* set_feature(f, "DISTANCE_TO_KINGS", (player_dist - opponent_dist) * king_dist_discount); */
 }
 
 /* Helper functions */
-int ShogiFeatures::distance(int posA, int posB){
+int ShogiFeatures::distance(int posA, int posB) const {
 	int asuji = posSuji(posA);
 	int adan = posDan(posA);
 	int bsuji = posSuji(posB);
@@ -1195,7 +1419,7 @@ int ShogiFeatures::distance(int posA, int posB){
 	return ((asuji - adan)*(asuji - adan) + (bsuji - bdan)*(bsuji - bdan)) / 10;
 }
 
-vector<int> ShogiFeatures::find_adjacent(int pos) {
+vector<int> ShogiFeatures::find_adjacent(int pos) const {
     // Inialize the vector
     vector<int> adjacent(8, -1);
 
@@ -1229,8 +1453,9 @@ vector<int> ShogiFeatures::find_adjacent(int pos) {
     return adjacent;
 }
 
-int ShogiFeatures::count_adj_pairs(string piece_type, Shogi& s) {
-    vector<int> pieces = piece_pos[piece_type].first;
+int ShogiFeatures::count_adj_pairs(string piece_type, Shogi& s, FeatureScratch& f) const {
+    int player = f.player;
+    vector<int> pieces = f.piece_pos[piece_type].first;
 
     // Map to insure not coutned twice
     map<int, int> seen;
@@ -1259,10 +1484,10 @@ int ShogiFeatures::count_adj_pairs(string piece_type, Shogi& s) {
     return adj_pair;
 }
 
-void ShogiFeatures::print_piece_map() {
-    string curr = player == SENTE ? "Sente" : "Gote";
-    string opp = player == SENTE ? "Gote" : "Sente";
-    for (auto& entry : piece_pos) {
+void ShogiFeatures::print_piece_map(FeatureScratch& f) const {
+    string curr = f.player == SENTE ? "Sente" : "Gote";
+    string opp = f.player == SENTE ? "Gote" : "Sente";
+    for (auto& entry : f.piece_pos) {
         cout << "--- " << entry.first << " ---" << endl;
         cout << "     " << curr << ": ";
         print_vec(entry.second.first);
@@ -1271,8 +1496,8 @@ void ShogiFeatures::print_piece_map() {
     }
 }
 
-int ShogiFeatures::count_safe_squares(vector<int> squares, Shogi& s)  {
-    int opp = player ^ 1;
+int ShogiFeatures::count_safe_squares(vector<int> squares, Shogi& s, FeatureScratch& f) const {
+    int opp = f.player ^ 1;
     vector<int> safe = {};
     for (int pos : squares) {
         if (!s.boardFixedAttacking[opp][pos].size() and !s.boardFlowAttacking[opp][pos].size()) {
@@ -1283,11 +1508,11 @@ int ShogiFeatures::count_safe_squares(vector<int> squares, Shogi& s)  {
     return safe.size();
 }
 
-vector<int> ShogiFeatures::find_flow_moves(string piece_type, Shogi& s) {
+vector<int> ShogiFeatures::find_flow_moves(string piece_type, Shogi& s, FeatureScratch& f) const {
 
     string up_piece = "+" + piece_type;
-    vector<int> pieces = piece_pos[piece_type].first;
-    pieces.insert(pieces.end(), piece_pos[up_piece].first.begin(), piece_pos[up_piece].first.end());
+    vector<int> pieces = f.piece_pos[piece_type].first;
+    pieces.insert(pieces.end(), f.piece_pos[up_piece].first.begin(), f.piece_pos[up_piece].first.end());
 
     vector<int> squares = {};
     for (int pos : pieces) {
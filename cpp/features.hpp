@@ -4,6 +4,8 @@
 #include <chrono>
 #include <numeric>
 #include <map>
+#include <array>
+#include <climits>
 #include <iostream>
 
 // For timing execution
@@ -11,6 +13,101 @@ using namespace std::chrono;
 
 vector<pair<string, int>> loadGames(string in_file);
 
+/* ------------------ Compile time feature set configuration ------------------ */
+
+// Each flag can be overridden from the Makefile (FEATURE_FLAGS) to build a specialized module,
+// for example: make FEATURE_FLAGS="-D GROUP_PROMOTIONS=1 -D KING_DIST_DIFF=1"
+#ifndef GROUP_PROMOTIONS
+#define GROUP_PROMOTIONS 0
+#endif
+#ifndef IN_HAND_BONUS
+#define IN_HAND_BONUS 1
+#endif
+#ifndef KING_DIST_DIFF
+#define KING_DIST_DIFF 0
+#endif
+#ifndef LINK_MATERIAL
+#define LINK_MATERIAL 1
+#endif
+
+struct FeatureConfig {
+    // Single value for gold and every piece that moves like a gold instead of individual promotion bonuses
+    static constexpr bool group_promotions = GROUP_PROMOTIONS;
+    // Individual bonus for each piece type in hand instead of a total count of pieces in hand
+    static constexpr bool in_hand_bonus = IN_HAND_BONUS;
+    // Single distance to kings difference per piece type instead of friendly and enemy distances
+    static constexpr bool king_dist_diff = KING_DIST_DIFF;
+    // Add the base piece weight to linked bonus features (promotions, pieces in hand) when scoring
+    static constexpr bool link_material = LINK_MATERIAL;
+
+    // Size of each block of features added in ShogiFeatures::init_features
+    static constexpr int n_piece_values = group_promotions ? 9 : 13;
+    static constexpr int n_in_hand = in_hand_bonus ? 7 : 1;
+    static constexpr int n_other_major = 4;
+    static constexpr int n_shape = 24;
+    static constexpr int n_king_dist = king_dist_diff ? 13 : 26;
+
+    static constexpr int n_features = n_piece_values + n_in_hand + n_other_major + n_shape + n_king_dist;
+    static constexpr int n_major_features = n_piece_values + (in_hand_bonus ? n_in_hand : 0) + n_other_major;
+};
+
+typedef array<int, FeatureConfig::n_features> FeatureArray;
+
+// Cumulative time (ns) and number of calls for each profiled section of the feature extraction.
+// Slots are indexed in the order of ShogiFeatures::profile_labels(), callers may append their own.
+struct FeatureProfile {
+    vector<long long> nanos;
+    vector<long long> calls;
+
+    void reset(int slots) { nanos.assign(slots, 0); calls.assign(slots, 0); }
+    void add(int slot, long long ns) { nanos[slot] += ns; calls[slot] += 1; }
+    void merge(const FeatureProfile& other);
+};
+
+// Lap timer that only reads the clock when a profile is attached, so the default path pays nothing
+class ProfileTimer {
+    public:
+        ProfileTimer(FeatureProfile* p) : profile(p) { if (profile) start = steady_clock::now(); }
+
+        // Restart the lap without charging the elapsed time to any slot
+        void restart() { if (profile) start = steady_clock::now(); }
+
+        // Charge the time since the last lap to the given slot and start timing the next section
+        void lap(int slot) {
+            if (!profile) return;
+            steady_clock::time_point now = steady_clock::now();
+            profile->add(slot, duration_cast<nanoseconds>(now - start).count());
+            start = now;
+        }
+
+    private:
+        FeatureProfile* profile;
+        steady_clock::time_point start;
+};
+
+// Per-extraction working state. ShogiFeatures itself is never modified while extracting features,
+// so each thread passes in its own scratch buffer and a single instance can be shared across threads.
+struct FeatureScratch {
+    // Perspective (SENTE / GOTE) the features are being calculated for
+    int player = SENTE;
+    int pawn_count = 0;
+
+    // Raw feature values in the same order as ShogiFeatures::features_vec_labels()
+    FeatureArray features;
+
+    // Cache the position(s) [0-81] of each kind of piece on the board since used many times in board shape feature
+    // Key is a piece type string (as in piece_strings of ShogiFeatures), value is a pair of vectors
+    // Pair.first  is the board locations of the given piece type for PLAYER
+    // Pair.second is the board locations of the given piece type for OPPONENT
+    // An example entry could be: {"+p", {<74, 81>, <12>}}
+    // If player is white this means they have two upgraded pawns on square 74 and 81, while black has one
+    // upgraded pawn on square 12
+    map<string, pair<vector<int>, vector<int>>> piece_pos;
+
+    // Optional instrumentation, timings of every feature function are accumulated here when set
+    FeatureProfile* profile = nullptr;
+};
+
 class ShogiFeatures {
     public:
 
@@ -34,17 +131,40 @@ class ShogiFeatures {
 
         // Multiple methods for evaluate depending on use in training or search
         int evaluate(Shogi s);
-        vector<int> feature_vec_raw(Shogi s) { return this->generate_feature_vec_raw(s); };
+
+        // Lazy evaluation for alpha-beta search. Features are calculated in tiers, starting with material
+        // and pieces in hand, and the remaining tiers are skipped once the partial score is outside the
+        // (alpha, beta) window by more than the weighted maximum of the features still to come. When the
+        // exact score is not needed the returned bound is still correct for the window (fail soft)
+        int evaluate(Shogi& s, int alpha, int beta);
+        vector<int> feature_vec_raw(Shogi s) { FeatureScratch f; return feature_vec_raw(s, player, f); };
         vector<string> features_vec_labels() { return feature_order; }
-        int evaluate_feature_vec(vector<int>& fV, vector<int>& weights);
+        int evaluate_feature_vec(const vector<int>& fV, const vector<int>& weights) const;
+
+        // Weights with the weight of each linked feature folded in, so a score is a plain dot product
+        vector<int> effective_weights(const vector<int>& weights) const;
+
+        // Reentrant feature extraction from the perspective of the given player. All intermediate
+        // state lives in the caller provided scratch buffer so this is safe to call from many threads
+        vector<int> feature_vec_raw(Shogi& s, int perspective, FeatureScratch& f) const;
+
+        // Sente and gote feature vectors from a single pass over the board. Piece positions, material,
+        // pieces in hand and aggression are calculated once and mirrored for gote
+        pair<vector<int>, vector<int>> feature_vecs_raw(Shogi& s, FeatureScratch& sente, FeatureScratch& gote) const;
 
         /* int evaluate(Shogi s, int* test_weights, int root_player, \ */
         /*     map<vector<unsigned char>, vector<int>>& tt, int& hits); */
         // int evaluate(Shogi s, vector<int>& weights, int root_player);
-        int num_features() { return n_features; }
-        int num_major_features() { return n_major_features; }
-        int getPawnCount() { return pawn_count; }
+        // Names of the profiled feature functions, in the slot order used by FeatureProfile
+        vector<string> profile_labels() const;
+
+        int num_features() const { return n_features; }
+        int num_major_features() const { return n_major_features; }
         int getPawnValue() { return pawn_value; }
+        int getPawnIndex() { return pawn_index; }
+
+        // Index of the weight a feature is linked to (see effective_weights), -1 if it is not linked
+        int feature_link(int feature) const { return feature_links[feature]; }
         int getPlayer() { return player; }
         void setPlayer(int newPlayer) { player = newPlayer; }
         void setPrint(int p) { print = p; }
@@ -53,20 +173,36 @@ class ShogiFeatures {
         int print;
         int player;
         vector<int> weights;
-        int n_major_features;
-        int n_features;
         int pawn_index;
-        int pawn_count;
         int pawn_value;
         int king_dist_discount;
 
-        bool king_dist_diff;
-        bool group_promotions;
-        bool in_hand_bonus;
-        bool link_material;
+        static constexpr int n_major_features = FeatureConfig::n_major_features;
+        static constexpr int n_features = FeatureConfig::n_features;
+
+        static constexpr bool king_dist_diff = FeatureConfig::king_dist_diff;
+        static constexpr bool group_promotions = FeatureConfig::group_promotions;
+        static constexpr bool in_hand_bonus = FeatureConfig::in_hand_bonus;
+        static constexpr bool link_material = FeatureConfig::link_material;
 
         void init_features();
-        map<string, int> features;
+
+        // Tier each feature is calculated in, found by running the feature functions on the initial board
+        static constexpr int n_tiers = 3;
+        FeatureArray feature_tiers;
+        void init_tiers();
+
+        // Largest absolute value each feature can take, used to bound the contribution of unevaluated tiers
+        FeatureArray feature_bounds;
+        void init_bounds();
+
+        // Maximum weighted contribution of all features calculated after the given tier
+        array<int, n_tiers> tier_margins;
+        void init_tier_margins();
+
+        // Index of each feature name in the raw feature vector
+        map<string, int> feature_index;
+        void set_feature(FeatureScratch& f, const string& name, int value) const;
 
         // Keep track of the names and indexes of features in the feature vector
         // Major determines if it is a major feature and deserves larger bit width or if it is linked to
@@ -75,7 +211,10 @@ class ShogiFeatures {
 
         // Preserve the order of initialization as it is used later to split major and minor bit widths
         vector<string> feature_order;
-        map<string, int> feature_links;
+
+        // Index of the weight each feature is linked to, -1 if the feature is not linked
+        FeatureArray feature_links;
+        int n_major_added;
 
 
         string pawn = "p";
@@ -88,15 +227,6 @@ class ShogiFeatures {
 
         vector<string> in_hand_order = {"p", "l", "n", "s", "g", "b", "r"};
 
-        // Cache the position(s) [0-81] of each kind of piece on the board since used many times in board shape feature
-        // Key is a piece type string (as in piece_strings above), value is a pair of vectors
-        // Pair.first  is the board locations of the given piece type for PLAYER
-        // Pair.second is the board locations of the given piece type for OPPONENT
-        // An example entry could be: {"+p", {<74, 81>, <12>}}
-        // If player is white this means they have two upgraded pawns on square 74 and 81, while black has one
-        // upgraded pawn on square 12
-        map<string, pair<vector<int>, vector<int>>> piece_pos;
-
         // Pieces that move the same as gold
         map<string, int> move_as_gold = {{"g", 1}, {"+n", 1}, {"+s", 1}, {"+l", 1}, {"+p", 1}};
 
@@ -115,7 +245,7 @@ class ShogiFeatures {
          *     -1  XX  71     indexed as:   3     4
          *     -1  -1  -1 ]                 5  6  7 ]
         */
-        vector<int> find_adjacent(int pos);
+        vector<int> find_adjacent(int pos) const;
 
         /*
          * Constants and other thresholds used by some of the features.
@@ -130,57 +260,70 @@ class ShogiFeatures {
         int botL = 5, bot = 6, botR = 7;
 
         // Helper Functions
-        bool in_bounds(int pos) { return (0 <= pos and pos <= 80); }
-        int count_adj_pairs(string piece_type, Shogi& s);
-        vector<int> find_flow_moves(string piece_type, Shogi& s);
-        int count_safe_squares(vector<int> squares, Shogi& s);
-        int distance(int posA, int posB);
-
-        vector<int> generate_feature_vec_raw(Shogi s);
-        void load_features(Shogi& s);
+        bool in_bounds(int pos) const { return (0 <= pos and pos <= 80); }
+        int count_adj_pairs(string piece_type, Shogi& s, FeatureScratch& f) const;
+        vector<int> find_flow_moves(string piece_type, Shogi& s, FeatureScratch& f) const;
+        int count_safe_squares(vector<int> squares, Shogi& s, FeatureScratch& f) const;
+        int distance(int posA, int posB) const;
+
+        void load_features(Shogi& s, FeatureScratch& f) const;
+        void reset_scratch(int perspective, FeatureScratch& f) const;
+
+        // Table of every feature function in the order they are calculated. Antisymmetric functions
+        // produce exactly the negated values from the opposite perspective, so they only need to be
+        // calculated once when extracting features for both players. Tier orders the functions for lazy
+        // evaluation: 0 is material (no attack maps needed), 2 is reserved for the most expensive features
+        typedef void (ShogiFeatures::*FeatureFunction)(Shogi&, FeatureScratch&) const;
+        struct FeatureFunctionEntry {
+            string name;
+            FeatureFunction function;
+            bool antisymmetric;
+            int tier;
+        };
+        static const vector<FeatureFunctionEntry> feature_functions;
 
         // Feature functions
-        void material(Shogi& s);
-        void material_in_hand(Shogi& s);
-        void king_safety(Shogi& s);
-        void total_pieces_in_hand(Shogi& s);
-        void controlled_squares(Shogi& s);
-        void castle(Shogi& s);
+        void material(Shogi& s, FeatureScratch& f) const;
+        void material_in_hand(Shogi& s, FeatureScratch& f) const;
+        void king_safety(Shogi& s, FeatureScratch& f) const;
+        void total_pieces_in_hand(Shogi& s, FeatureScratch& f) const;
+        void controlled_squares(Shogi& s, FeatureScratch& f) const;
+        void castle(Shogi& s, FeatureScratch& f) const;
 
         // Penalty features for bad shape
-        void gold_ahead_silver_penalty(Shogi& s);
-        void gold_adjacent_rook_penalty(Shogi& s);
+        void gold_ahead_silver_penalty(Shogi& s, FeatureScratch& f) const;
+        void gold_adjacent_rook_penalty(Shogi& s, FeatureScratch& f) const;
         // Small penalty if bishop boxed in on at least bishop_box_penalty sides
-        void boxed_in_bishop_penalty(Shogi& s);
-        void piece_ahead_of_pawns_penalty(Shogi& s);
+        void boxed_in_bishop_penalty(Shogi& s, FeatureScratch& f) const;
+        void piece_ahead_of_pawns_penalty(Shogi& s, FeatureScratch& f) const;
 
         // Features for GOOD shape
-        void bishop_heads(Shogi& s);
-        void reclining_silver(Shogi& s);
-        void claimed_files(Shogi& s);
-        void adjacent_silvers(Shogi& s);
-        void adjacent_golds(Shogi& s);
-        void rook_enemy_camp(Shogi& s);
-        void rook_attack_king_file(Shogi& s);
-        void rook_attack_king_adj_file(Shogi& s);
-        void rook_attack_king_adj_file_9821(Shogi& s);
-        void rook_open_semi_open_file(Shogi& s);
-        void bishop_mobility(Shogi& s);
-        void rook_mobility(Shogi& s);
-        void aggression_balance(Shogi& s);
+        void bishop_heads(Shogi& s, FeatureScratch& f) const;
+        void reclining_silver(Shogi& s, FeatureScratch& f) const;
+        void claimed_files(Shogi& s, FeatureScratch& f) const;
+        void adjacent_silvers(Shogi& s, FeatureScratch& f) const;
+        void adjacent_golds(Shogi& s, FeatureScratch& f) const;
+        void rook_enemy_camp(Shogi& s, FeatureScratch& f) const;
+        void rook_attack_king_file(Shogi& s, FeatureScratch& f) const;
+        void rook_attack_king_adj_file(Shogi& s, FeatureScratch& f) const;
+        void rook_attack_king_adj_file_9821(Shogi& s, FeatureScratch& f) const;
+        void rook_open_semi_open_file(Shogi& s, FeatureScratch& f) const;
+        void bishop_mobility(Shogi& s, FeatureScratch& f) const;
+        void rook_mobility(Shogi& s, FeatureScratch& f) const;
+        void aggression_balance(Shogi& s, FeatureScratch& f) const;
 
         // Try to help with drops, count the number of pieces that are blocking flow of an enemy
-        void blocked_flow(Shogi& s);
+        void blocked_flow(Shogi& s, FeatureScratch& f) const;
 
-        void king_attack(Shogi& s);
-        void distance_to_kings(Shogi& s);
+        void king_attack(Shogi& s, FeatureScratch& f) const;
+        void distance_to_kings(Shogi& s, FeatureScratch& f) const;
 
         // General difference in the number of squares each player is attacking. Should give a good
         // Idea about spacinf of a players pieces.
-        void total_attacking(Shogi& s);
+        void total_attacking(Shogi& s, FeatureScratch& f) const;
 
         // Used for visual debugging
-        void print_piece_map();
+        void print_piece_map(FeatureScratch& f) const;
 
 
         // Used to decide moves, coppied from shogi.cpp because shogi.cpp clobers global namespace
@@ -1,14 +1,15 @@
 #include "game.hpp"
 
-Game::Game(Shogi game, Agent* agent1, Agent* agent2) : sente(agent1), gote(agent2) {
-    s = game;
-}
+Game::Game(Shogi game, Agent* agent1, Agent* agent2, bool verbose) : s(game), sente(agent1), gote(agent2), verbose(verbose) {}
 
 // Playout the game between the two players and determine a winner
 int Game::play(int max_round) {
 	while(s.round < max_round) {
-    s.EasyBoardPrint();
+    if (verbose) {
+        s.EasyBoardPrint();
+    }
     if (s.round % 2 == 0) {
+        sente->setBoard(s);
         int move = sente->getMove();
         if (move == -1) {
             // No Moves for Sente, return gote winner
@@ -16,6 +17,7 @@ int Game::play(int max_round) {
         }
         s.MakeMove(move);
     } else {
+        gote->setBoard(s);
         int move = gote->getMove();
         if (move == -1) {
             // No moves for gote, return sente winner
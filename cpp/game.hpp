@@ -1,11 +1,12 @@
+#pragma once
 #include "agent.hpp"
 
 
 class Game {
 	public:
-		Game(Shogi s, Agent* agent1, Agent* agent2);
+		Game(Shogi s, Agent* agent1, Agent* agent2, bool verbose = true);
 
-    // Play a game between two agents and return a winner
+    // Play a game between two agents and return a winner (0 sente, 1 gote), -1 once max_round is reached
 		int play(int max_round);
 
 	private:
@@ -15,6 +16,8 @@ class Game {
     const int sente_win = 0;
     const int gote_win = 1;
 
+		bool verbose;
+
 		unsigned int gameState;
 		unsigned int moves = 0;
 
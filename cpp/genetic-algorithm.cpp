@@ -0,0 +1,712 @@
+#include "genetic-algorithm.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <unistd.h>
+
+GeneticAlgorithm::GeneticAlgorithm(OrganismEvaluator& evaluator, GAConfig config)
+    : evaluator(evaluator), config(config), rng(config.seed) {
+
+    if (config.pop_size < 2) {
+        throw invalid_argument("Population needs at least 2 organisms");
+    }
+    if (config.bit_width_small < 1 or config.bit_width_small > 16
+            or config.bit_width_wide < 1 or config.bit_width_wide > 16) {
+        throw invalid_argument("Bit widths must be between 1 and 16");
+    }
+    if (config.selection != "roulette" and config.selection != "tournament") {
+        throw invalid_argument("Selection must be roulette or tournament");
+    }
+    if (config.selection == "tournament" and config.tournament_size < 1) {
+        throw invalid_argument("Tournament size must be positive");
+    }
+
+    n_features = evaluator.get_num_features();
+    n_major = evaluator.get_num_major_features();
+    n_bits = n_major * config.bit_width_wide + (n_features - n_major) * config.bit_width_small;
+    n_words = (n_bits + 63) / 64 + 1;
+
+    int pawn_width = n_major > 0 ? config.bit_width_wide : config.bit_width_small;
+    if (config.pawn_value >= (1 << pawn_width)) {
+        throw invalid_argument("Pawn value does not fit in " + to_string(pawn_width) + " bits");
+    }
+
+    used_bits.assign(n_words, 0);
+    for (int i = 0; i < n_bits; i++) {
+        used_bits[i / 64] |= 1ULL << (63 - i % 64);
+    }
+
+    // The Gray code of b is b ^ (b >> 1), invert it once for every value of each width
+    gray_small.resize(1 << config.bit_width_small);
+    for (int b = 0; b < (int)gray_small.size(); b++) gray_small[b ^ (b >> 1)] = b;
+    gray_wide.resize(1 << config.bit_width_wide);
+    for (int b = 0; b < (int)gray_wide.size(); b++) gray_wide[b ^ (b >> 1)] = b;
+
+    // Random initial population, like tools.initRepeat over random bits
+    genomes.resize((size_t)config.pop_size * n_words);
+    for (int o = 0; o < config.pop_size; o++) {
+        uint64_t* g = genome(o);
+        for (int w = 0; w < n_words; w++) {
+            g[w] = rng() & used_bits[w];
+        }
+        fix_pawn(g);
+    }
+    fitness.assign(config.pop_size, 0);
+    valid.assign(config.pop_size, 0);
+    best_genome.assign(genome(0), genome(0) + n_words);
+}
+
+vector<int> GeneticAlgorithm::unpack(const uint64_t* g) const {
+    vector<int> bits(n_bits);
+    for (int i = 0; i < n_bits; i++) {
+        bits[i] = (g[i / 64] >> (63 - i % 64)) & 1;
+    }
+    return bits;
+}
+
+vector<int> GeneticAlgorithm::decode(const uint64_t* g) const {
+    vector<int> weights(n_features);
+    int bit = 0;
+    for (int i = 0; i < n_features; i++) {
+        int width = i < n_major ? config.bit_width_wide : config.bit_width_small;
+        const vector<int>& table = i < n_major ? gray_wide : gray_small;
+
+        // 64 bits starting at the gene, the padding word keeps the read in bounds
+        int word = bit / 64, offset = bit % 64;
+        uint64_t window = g[word] << offset;
+        if (offset) window |= g[word + 1] >> (64 - offset);
+
+        weights[i] = table[window >> (64 - width)];
+        bit += width;
+    }
+    return weights;
+}
+
+void GeneticAlgorithm::fix_pawn(uint64_t* g) {
+    if (config.pawn_value < 0) return;
+
+    int width = n_major > 0 ? config.bit_width_wide : config.bit_width_small;
+    uint64_t gray = config.pawn_value ^ (config.pawn_value >> 1);
+    uint64_t mask = ((1ULL << width) - 1) << (64 - width);
+    g[0] = (g[0] & ~mask) | (gray << (64 - width));
+}
+
+vector<int> GeneticAlgorithm::get_genome(int organism) const {
+    if (organism < 0 or organism >= config.pop_size) {
+        throw out_of_range("No organism " + to_string(organism));
+    }
+    return unpack(genome(organism));
+}
+
+vector<int> GeneticAlgorithm::get_weights(int organism) const {
+    if (organism < 0 or organism >= config.pop_size) {
+        throw out_of_range("No organism " + to_string(organism));
+    }
+    return decode(genome(organism));
+}
+
+void GeneticAlgorithm::set_genome(int organism, const vector<int>& bits) {
+    if (organism < 0 or organism >= config.pop_size) {
+        throw out_of_range("No organism " + to_string(organism));
+    }
+    if ((int)bits.size() != n_bits) {
+        throw invalid_argument("Expected a genome of " + to_string(n_bits) + " bits");
+    }
+
+    uint64_t* g = genome(organism);
+    fill(g, g + n_words, 0);
+    for (int i = 0; i < n_bits; i++) {
+        if (bits[i]) g[i / 64] |= 1ULL << (63 - i % 64);
+    }
+    fix_pawn(g);
+    valid[organism] = 0;
+}
+
+uint64_t GeneticAlgorithm::random_mask(double p) {
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i++) {
+        mask = (mask << 1) | (uniform() < p ? 1 : 0);
+    }
+    return mask;
+}
+
+/* Uniform crossover (tools.cxUniform), each bit is swapped between the genomes with probability cx_indpb */
+void GeneticAlgorithm::crossover(uint64_t* a, uint64_t* b) {
+    for (int w = 0; w < n_words; w++) {
+        uint64_t swap = (a[w] ^ b[w]) & random_mask(config.cx_indpb);
+        a[w] ^= swap;
+        b[w] ^= swap;
+    }
+}
+
+/* Flip bit mutation (tools.mutFlipBit), each bit is flipped with probability mut_indpb */
+void GeneticAlgorithm::mutate(uint64_t* g) {
+    for (int w = 0; w < n_words; w++) {
+        g[w] ^= random_mask(config.mut_indpb) & used_bits[w];
+    }
+}
+
+int GeneticAlgorithm::select_one(const vector<double>& cumulative) {
+    int n = config.pop_size;
+    if (config.selection == "tournament") {
+        int best = rng() % n;
+        for (int k = 1; k < config.tournament_size; k++) {
+            int challenger = rng() % n;
+            if (fitness[challenger] > fitness[best]) best = challenger;
+        }
+        return best;
+    }
+
+    // Roulette, chance proportional to fitness (uniform when every fitness is zero)
+    double total = cumulative.back();
+    if (total <= 0) return rng() % n;
+    double u = uniform() * total;
+    int chosen = upper_bound(cumulative.begin(), cumulative.end(), u) - cumulative.begin();
+    return min(chosen, n - 1);
+}
+
+void GeneticAlgorithm::collect(vector<int>& organisms, vector<vector<int>>& weights) {
+    organisms.clear();
+    for (int o = 0; o < config.pop_size; o++) {
+        if (valid[o]) continue;
+        fix_pawn(genome(o));
+        organisms.push_back(o);
+        weights.push_back(decode(genome(o)));
+    }
+}
+
+void GeneticAlgorithm::assign(const vector<int>& organisms, const int* result) {
+    for (size_t i = 0; i < organisms.size(); i++) {
+        int o = organisms[i];
+        fitness[o] = result[i];
+        valid[o] = 1;
+
+        if (fitness[o] > best_fitness) {
+            best_fitness = fitness[o];
+            best_genome.assign(genome(o), genome(o) + n_words);
+        }
+    }
+}
+
+int GeneticAlgorithm::evaluate() {
+    vector<int> organisms;
+    vector<vector<int>> weights;
+    collect(organisms, weights);
+    if (organisms.empty()) return 0;
+
+    vector<int> result = evaluator.evaluate_population(weights);
+    assign(organisms, result.data());
+    return organisms.size();
+}
+
+void GeneticAlgorithm::replace(int organism, const uint64_t* g, int organism_fitness, bool organism_valid) {
+    copy(g, g + n_words, genome(organism));
+    fitness[organism] = organism_fitness;
+    valid[organism] = organism_valid;
+
+    if (organism_valid and organism_fitness > best_fitness) {
+        best_fitness = organism_fitness;
+        best_genome.assign(g, g + n_words);
+    }
+}
+
+map<string, double> GeneticAlgorithm::record(int nevals, long long time_ms) {
+    double sum = 0, sum_sq = 0;
+    for (int f : fitness) {
+        sum += f;
+        sum_sq += (double)f * f;
+    }
+    double avg = sum / config.pop_size;
+
+    return {
+        {"gen", (double)generation},
+        {"nevals", (double)nevals},
+        {"time_ms", (double)time_ms},
+        {"avg", avg},
+        {"std", sqrt(max(0.0, sum_sq / config.pop_size - avg * avg))},
+        {"min", (double)*min_element(fitness.begin(), fitness.end())},
+        {"max", (double)*max_element(fitness.begin(), fitness.end())}
+    };
+}
+
+void GeneticAlgorithm::breed() {
+    int n = config.pop_size;
+    generation++;
+
+    // Keep the best organism as is
+    int elite = max_element(fitness.begin(), fitness.end()) - fitness.begin();
+
+    vector<double> cumulative(n);
+    double total = 0;
+    for (int o = 0; o < n; o++) {
+        total += fitness[o];
+        cumulative[o] = total;
+    }
+
+    // Select the rest of the next generation from the current one
+    vector<uint64_t> next((size_t)n * n_words);
+    vector<int> next_fitness(n);
+    vector<char> next_valid(n);
+    for (int o = 0; o < n - 1; o++) {
+        int chosen = select_one(cumulative);
+        copy(genome(chosen), genome(chosen) + n_words, &next[(size_t)o * n_words]);
+        next_fitness[o] = fitness[chosen];
+        next_valid[o] = valid[chosen];
+    }
+    copy(genome(elite), genome(elite) + n_words, &next[(size_t)(n - 1) * n_words]);
+    next_fitness[n - 1] = fitness[elite];
+    next_valid[n - 1] = valid[elite];
+
+    genomes.swap(next);
+    fitness.swap(next_fitness);
+    valid.swap(next_valid);
+
+    // Crossover of consecutive pairs then mutation, never touching the elite (varAnd)
+    for (int o = 1; o < n - 1; o += 2) {
+        if (uniform() < config.cxpb) {
+            crossover(genome(o - 1), genome(o));
+            valid[o - 1] = valid[o] = 0;
+        }
+    }
+    for (int o = 0; o < n - 1; o++) {
+        if (uniform() < config.mutpb) {
+            mutate(genome(o));
+            valid[o] = 0;
+        }
+    }
+
+    // Each generation is scored on its own mini-batch, fitness from the last one is not comparable
+    if (evaluator.get_batch_size() > 0) {
+        evaluator.set_generation(generation);
+        fill(valid.begin(), valid.end(), 0);
+    }
+}
+
+vector<map<string, double>> GeneticAlgorithm::run_generations(int n_gen) {
+    vector<map<string, double>> log;
+
+    if (!started) {
+        auto start = steady_clock::now();
+        if (evaluator.get_batch_size() > 0) {
+            evaluator.set_generation(generation);
+        }
+        int nevals = evaluate();
+        started = true;
+        log.push_back(record(nevals, duration_cast<milliseconds>(steady_clock::now() - start).count()));
+        if (checkpoint_interval > 0) save_checkpoint(checkpoint_path);
+    }
+
+    for (int k = 0; k < n_gen; k++) {
+        auto start = steady_clock::now();
+        breed();
+        int nevals = evaluate();
+        log.push_back(record(nevals, duration_cast<milliseconds>(steady_clock::now() - start).count()));
+        if (checkpoint_interval > 0 and generation % checkpoint_interval == 0) save_checkpoint(checkpoint_path);
+    }
+
+    return log;
+}
+
+/* Checkpoints start with a magic string, a format version and what wrote them, followed by a reference
+   to the feature matrix, the GAConfig and the state of every population. Values are written in native
+   byte order, strings and arrays are prefixed by their length */
+static const char checkpoint_magic[8] = {'G', 'S', 'H', 'O', 'G', 'I', 'G', 'A'};
+static const uint32_t checkpoint_version = 1;
+enum CheckpointKind : uint32_t { checkpoint_single = 0, checkpoint_islands = 1 };
+
+class CheckpointWriter {
+    public:
+        explicit CheckpointWriter(FILE* out) : out(out) {}
+
+        template <typename T> void value(const T& v) { bytes(&v, sizeof(T)); }
+        void text(const string& s) { value((uint64_t)s.size()); bytes(s.data(), s.size()); }
+        template <typename T> void array(const vector<T>& v) { value((uint64_t)v.size()); bytes(v.data(), v.size() * sizeof(T)); }
+        void bytes(const void* data, size_t size) { ok = ok and (size == 0 or fwrite(data, size, 1, out) == 1); }
+        bool good() const { return ok; }
+
+    private:
+        FILE* out;
+        bool ok = true;
+};
+
+class CheckpointReader {
+    public:
+        explicit CheckpointReader(const string& path) : path(path), in(fopen(path.c_str(), "rb")) {
+            if (!in) throw runtime_error("Could not open checkpoint " + path);
+        }
+        ~CheckpointReader() { fclose(in); }
+
+        template <typename T> T value() { T v; bytes(&v, sizeof(T)); return v; }
+        string text() { string s(length(), '\0'); bytes(&s[0], s.size()); return s; }
+        template <typename T> vector<T> array() { vector<T> v(length()); bytes(v.data(), v.size() * sizeof(T)); return v; }
+        void bytes(void* data, size_t size) {
+            if (size != 0 and fread(data, size, 1, in) != 1) throw runtime_error("Checkpoint " + path + " is truncated");
+        }
+        void corrupt() { throw runtime_error("Checkpoint " + path + " is corrupt"); }
+
+    private:
+        string path;
+        FILE* in;
+
+        uint64_t length() {
+            uint64_t n = value<uint64_t>();
+            if (n > (1ULL << 32)) corrupt();
+            return n;
+        }
+};
+
+/* Write a checkpoint to a temporary file, flush it to disk and rename it over path */
+static void write_checkpoint(const string& path, CheckpointKind kind, OrganismEvaluator& evaluator,
+                             const GAConfig& config, const function<void(CheckpointWriter&)>& write_body) {
+    string tmp_path = path + ".tmp." + to_string(getpid());
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    if (!file) throw runtime_error("Could not write checkpoint " + tmp_path);
+
+    CheckpointWriter out(file);
+    out.bytes(checkpoint_magic, sizeof(checkpoint_magic));
+    out.value(checkpoint_version);
+    out.value((uint32_t)kind);
+
+    // The matrix is saved under its data key in the cache directory, resuming maps it back
+    out.value(evaluator.get_data_key());
+    out.value((int32_t)evaluator.get_num_eval());
+    out.value((int32_t)evaluator.get_batch_size());
+    out.value((uint32_t)evaluator.get_batch_seed());
+    out.text(evaluator.get_cache_dir());
+
+    out.value((int32_t)config.pop_size);
+    out.value(config.cxpb);
+    out.value(config.mutpb);
+    out.value(config.cx_indpb);
+    out.value(config.mut_indpb);
+    out.value((int32_t)config.bit_width_small);
+    out.value((int32_t)config.bit_width_wide);
+    out.text(config.selection);
+    out.value((int32_t)config.tournament_size);
+    out.value((int32_t)config.pawn_value);
+    out.value((uint32_t)config.seed);
+
+    write_body(out);
+
+    bool ok = out.good() and fflush(file) == 0 and fsync(fileno(file)) == 0;
+    ok = (fclose(file) == 0) and ok;
+    if (!ok or rename(tmp_path.c_str(), path.c_str()) != 0) {
+        remove(tmp_path.c_str());
+        throw runtime_error("Could not write checkpoint " + path);
+    }
+}
+
+/* Read a checkpoint up to the end of its GAConfig. With an evaluator, also restore the positions it scores */
+static GAConfig read_checkpoint_header(CheckpointReader& in, CheckpointKind kind, OrganismEvaluator* evaluator) {
+    char magic[sizeof(checkpoint_magic)];
+    in.bytes(magic, sizeof(magic));
+    if (memcmp(magic, checkpoint_magic, sizeof(magic)) != 0) in.corrupt();
+    if (in.value<uint32_t>() != checkpoint_version) {
+        throw runtime_error("Checkpoint was written by another version");
+    }
+    if (in.value<uint32_t>() != (uint32_t)kind) {
+        throw runtime_error(kind == checkpoint_islands ? "Checkpoint is not of an island model"
+                                                       : "Checkpoint is of an island model");
+    }
+
+    uint64_t key = in.value<uint64_t>();
+    int n_eval = in.value<int32_t>();
+    int batch_size = in.value<int32_t>();
+    unsigned batch_seed = in.value<uint32_t>();
+    string cache_dir = in.text();
+    if (evaluator) {
+        if (!cache_dir.empty()) evaluator->set_cache_dir(cache_dir);
+        if (evaluator->get_data_key() != key) {
+            throw runtime_error("Checkpoint was written for another dataset, mode or feature set");
+        }
+        evaluator->set_num_eval(n_eval);
+        evaluator->set_batch(batch_size, batch_seed);
+    }
+
+    GAConfig config;
+    config.pop_size = in.value<int32_t>();
+    config.cxpb = in.value<double>();
+    config.mutpb = in.value<double>();
+    config.cx_indpb = in.value<double>();
+    config.mut_indpb = in.value<double>();
+    config.bit_width_small = in.value<int32_t>();
+    config.bit_width_wide = in.value<int32_t>();
+    config.selection = in.text();
+    config.tournament_size = in.value<int32_t>();
+    config.pawn_value = in.value<int32_t>();
+    config.seed = in.value<uint32_t>();
+    return config;
+}
+
+static GAConfig checkpoint_config(const string& path, CheckpointKind kind) {
+    CheckpointReader in(path);
+    return read_checkpoint_header(in, kind, nullptr);
+}
+
+GeneticAlgorithm::GeneticAlgorithm(OrganismEvaluator& evaluator, const string& checkpoint)
+    : GeneticAlgorithm(evaluator, checkpoint_config(checkpoint, checkpoint_single)) {
+
+    CheckpointReader in(checkpoint);
+    read_checkpoint_header(in, checkpoint_single, &evaluator);
+    read_state(in);
+}
+
+void GeneticAlgorithm::save_checkpoint(const string& path) const {
+    write_checkpoint(path, checkpoint_single, evaluator, config, [this](CheckpointWriter& out) { write_state(out); });
+}
+
+void GeneticAlgorithm::set_checkpoint(const string& path, int interval) {
+    if (interval < 0) {
+        throw invalid_argument("Checkpoint interval must be positive, or 0 to stop checkpointing");
+    }
+    checkpoint_path = path;
+    checkpoint_interval = interval;
+}
+
+void GeneticAlgorithm::write_state(CheckpointWriter& out) const {
+    // mt19937_64 only exposes its full state through streams
+    stringstream rng_state;
+    rng_state << rng;
+
+    out.value((int32_t)n_bits);
+    out.value((int32_t)generation);
+    out.value((uint8_t)started);
+    out.value((int32_t)best_fitness);
+    out.text(rng_state.str());
+    out.array(genomes);
+    out.array(fitness);
+    out.array(valid);
+    out.array(best_genome);
+}
+
+void GeneticAlgorithm::read_state(CheckpointReader& in) {
+    if (in.value<int32_t>() != n_bits) {
+        throw runtime_error("Checkpoint genomes do not match the features of the evaluator");
+    }
+    generation = in.value<int32_t>();
+    started = in.value<uint8_t>();
+    best_fitness = in.value<int32_t>();
+
+    stringstream rng_state(in.text());
+    rng_state >> rng;
+    if (rng_state.fail()) in.corrupt();
+
+    genomes = in.array<uint64_t>();
+    fitness = in.array<int>();
+    valid = in.array<char>();
+    best_genome = in.array<uint64_t>();
+    if (genomes.size() != (size_t)config.pop_size * n_words or fitness.size() != (size_t)config.pop_size
+            or valid.size() != (size_t)config.pop_size or best_genome.size() != (size_t)n_words) {
+        in.corrupt();
+    }
+}
+
+IslandModel::IslandModel(OrganismEvaluator& evaluator, GAConfig config, IslandConfig island_config)
+    : evaluator(evaluator), island_config(island_config) {
+
+    if (island_config.n_islands < 1) {
+        throw invalid_argument("Need at least one island");
+    }
+    if (island_config.migration_interval < 1) {
+        throw invalid_argument("Migration interval must be positive");
+    }
+    if (island_config.n_migrants < 0 or island_config.n_migrants >= config.pop_size) {
+        throw invalid_argument("Migrants must be fewer than the organisms of an island");
+    }
+    if (island_config.topology != "ring" and island_config.topology != "complete") {
+        throw invalid_argument("Topology must be ring or complete");
+    }
+    if (island_config.topology == "complete"
+            and island_config.n_migrants * (island_config.n_islands - 1) >= config.pop_size) {
+        throw invalid_argument("Migrants from every other island must be fewer than the organisms of an island");
+    }
+
+    // Every island has its own random stream
+    for (int i = 0; i < island_config.n_islands; i++) {
+        GAConfig island = config;
+        island.seed = config.seed + i;
+        islands.emplace_back(new GeneticAlgorithm(evaluator, island));
+    }
+}
+
+vector<int> IslandModel::evaluate() {
+    int n_islands = islands.size();
+    vector<vector<int>> organisms(n_islands);
+    vector<vector<int>> weights;
+    for (int i = 0; i < n_islands; i++) {
+        islands[i]->collect(organisms[i], weights);
+    }
+
+    vector<int> nevals(n_islands, 0);
+    if (weights.empty()) return nevals;
+
+    vector<int> result = evaluator.evaluate_population(weights);
+    size_t offset = 0;
+    for (int i = 0; i < n_islands; i++) {
+        islands[i]->assign(organisms[i], result.data() + offset);
+        offset += organisms[i].size();
+        nevals[i] = organisms[i].size();
+    }
+    return nevals;
+}
+
+void IslandModel::migrate() {
+    int n_islands = islands.size();
+    int n_migrants = island_config.n_migrants;
+    if (n_islands < 2 or n_migrants == 0) return;
+
+    // Best organisms of every island, taken before any island receives migrants
+    vector<vector<int>> migrants(n_islands);
+    for (int i = 0; i < n_islands; i++) {
+        const vector<int>& fitness = islands[i]->fitness;
+        vector<int> order(fitness.size());
+        for (size_t o = 0; o < order.size(); o++) order[o] = o;
+        partial_sort(order.begin(), order.begin() + n_migrants, order.end(),
+                     [&fitness](int a, int b) { return fitness[a] > fitness[b]; });
+        migrants[i].assign(order.begin(), order.begin() + n_migrants);
+    }
+
+    // Islands each island receives migrants from
+    vector<vector<int>> sources(n_islands);
+    for (int i = 0; i < n_islands; i++) {
+        if (island_config.topology == "ring") {
+            sources[(i + 1) % n_islands].push_back(i);
+        } else {
+            for (int j = 0; j < n_islands; j++) {
+                if (j != i) sources[j].push_back(i);
+            }
+        }
+    }
+
+    // Copies of the migrants, so an island sending and receiving in the same round sends its own organisms
+    vector<vector<uint64_t>> genomes(n_islands);
+    vector<vector<int>> fitness(n_islands);
+    vector<vector<char>> valid(n_islands);
+    for (int i = 0; i < n_islands; i++) {
+        GeneticAlgorithm& island = *islands[i];
+        for (int o : migrants[i]) {
+            genomes[i].insert(genomes[i].end(), island.genome(o), island.genome(o) + island.n_words);
+            fitness[i].push_back(island.fitness[o]);
+            valid[i].push_back(island.valid[o]);
+        }
+    }
+
+    // Migrants replace the worst organisms of the islands they arrive at
+    for (int j = 0; j < n_islands; j++) {
+        GeneticAlgorithm& island = *islands[j];
+        int arriving = sources[j].size() * n_migrants;
+        vector<int> order(island.fitness.size());
+        for (size_t o = 0; o < order.size(); o++) order[o] = o;
+        partial_sort(order.begin(), order.begin() + arriving, order.end(),
+                     [&island](int a, int b) { return island.fitness[a] < island.fitness[b]; });
+
+        int slot = 0;
+        for (int i : sources[j]) {
+            for (int m = 0; m < n_migrants; m++) {
+                island.replace(order[slot++], &genomes[i][(size_t)m * island.n_words], fitness[i][m], valid[i][m]);
+            }
+        }
+    }
+}
+
+vector<map<string, double>> IslandModel::run_generations(int n_gen) {
+    vector<map<string, double>> log;
+    int n_islands = islands.size();
+
+    // Islands advance in lockstep, so the organisms of every island are scored together in one pass
+    auto add_records = [&](const vector<int>& nevals, long long time_ms) {
+        for (int i = 0; i < n_islands; i++) {
+            map<string, double> entry = islands[i]->record(nevals[i], time_ms);
+            entry["island"] = i;
+            log.push_back(entry);
+        }
+    };
+
+    if (!started) {
+        auto start = steady_clock::now();
+        if (evaluator.get_batch_size() > 0) {
+            evaluator.set_generation(generation);
+        }
+        vector<int> nevals = evaluate();
+        for (auto& island : islands) island->started = true;
+        started = true;
+        add_records(nevals, duration_cast<milliseconds>(steady_clock::now() - start).count());
+        if (checkpoint_interval > 0) save_checkpoint(checkpoint_path);
+    }
+
+    for (int k = 0; k < n_gen; k++) {
+        auto start = steady_clock::now();
+        generation++;
+        for (auto& island : islands) island->breed();
+        vector<int> nevals = evaluate();
+
+        if (generation % island_config.migration_interval == 0) {
+            migrate();
+        }
+        add_records(nevals, duration_cast<milliseconds>(steady_clock::now() - start).count());
+        if (checkpoint_interval > 0 and generation % checkpoint_interval == 0) save_checkpoint(checkpoint_path);
+    }
+
+    return log;
+}
+
+int IslandModel::best_island() const {
+    int best = 0;
+    for (size_t i = 1; i < islands.size(); i++) {
+        if (islands[i]->get_best_fitness() > islands[best]->get_best_fitness()) best = i;
+    }
+    return best;
+}
+
+static IslandConfig read_island_config(CheckpointReader& in) {
+    IslandConfig island_config;
+    island_config.n_islands = in.value<int32_t>();
+    island_config.migration_interval = in.value<int32_t>();
+    island_config.n_migrants = in.value<int32_t>();
+    island_config.topology = in.text();
+    return island_config;
+}
+
+static IslandConfig checkpoint_island_config(const string& path) {
+    CheckpointReader in(path);
+    read_checkpoint_header(in, checkpoint_islands, nullptr);
+    return read_island_config(in);
+}
+
+IslandModel::IslandModel(OrganismEvaluator& evaluator, const string& checkpoint)
+    : IslandModel(evaluator, checkpoint_config(checkpoint, checkpoint_islands), checkpoint_island_config(checkpoint)) {
+
+    CheckpointReader in(checkpoint);
+    read_checkpoint_header(in, checkpoint_islands, &evaluator);
+    read_island_config(in);
+    generation = in.value<int32_t>();
+    started = in.value<uint8_t>();
+    for (auto& island : islands) {
+        island->read_state(in);
+    }
+}
+
+void IslandModel::save_checkpoint(const string& path) const {
+    // Islands only differ from the first one by their seed, which is derived from it
+    write_checkpoint(path, checkpoint_islands, evaluator, islands[0]->config, [this](CheckpointWriter& out) {
+        out.value((int32_t)island_config.n_islands);
+        out.value((int32_t)island_config.migration_interval);
+        out.value((int32_t)island_config.n_migrants);
+        out.text(island_config.topology);
+        out.value((int32_t)generation);
+        out.value((uint8_t)started);
+        for (auto& island : islands) {
+            island->write_state(out);
+        }
+    });
+}
+
+void IslandModel::set_checkpoint(const string& path, int interval) {
+    if (interval < 0) {
+        throw invalid_argument("Checkpoint interval must be positive, or 0 to stop checkpointing");
+    }
+    checkpoint_path = path;
+    checkpoint_interval = interval;
+}
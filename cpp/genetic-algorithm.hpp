@@ -0,0 +1,182 @@
+#pragma once
+#include "train.hpp"
+#include <random>
+#include <memory>
+
+// Settings of a GeneticAlgorithm. Defaults follow py/config.py and the DEAP operators registered in
+// py/evolve.py (uniform crossover, flip bit mutation, roulette selection)
+struct GAConfig {
+    int pop_size = 100;
+
+    // Probability a pair of offspring is crossed over, and that an offspring is mutated
+    double cxpb = 0.75;
+    double mutpb = 0.005;
+
+    // Probability each bit is swapped by crossover, and flipped by mutation
+    double cx_indpb = 0.4;
+    double mut_indpb = 0.05;
+
+    // Major features are encoded with the wide bit width, every other feature with the small one
+    int bit_width_small = 6;
+    int bit_width_wide = 12;
+
+    // "roulette" or "tournament"
+    string selection = "roulette";
+    int tournament_size = 3;
+
+    // Weight the first (pawn) gene is held at, -1 to evolve it like the others
+    int pawn_value = 100;
+
+    unsigned seed = 0;
+};
+
+// Settings of an IslandModel. Every migration_interval generations the n_migrants best organisms of each
+// island are copied over the worst organisms of the next island ("ring") or of every other island ("complete")
+struct IslandConfig {
+    int n_islands = 4;
+    int migration_interval = 5;
+    int n_migrants = 1;
+    string topology = "ring";
+};
+
+class CheckpointWriter;
+class CheckpointReader;
+
+// Generational genetic algorithm over Gray coded bit genomes, scored by an OrganismEvaluator. Mirrors
+// eaSimple in py/eAlgos.py: each generation keeps the best organism, selects the rest of the population
+// from the previous one, crosses over and mutates the selected copies and evaluates the changed ones.
+// Genomes are packed 64 bits to a word, and genes are decoded through Gray code lookup tables.
+class GeneticAlgorithm {
+    public:
+        GeneticAlgorithm(OrganismEvaluator& evaluator, GAConfig config);
+
+        // Resume from a checkpoint written by save_checkpoint. The evaluator is pointed at the feature
+        // matrix saved by the interrupted run and must be loaded with the same data
+        GeneticAlgorithm(OrganismEvaluator& evaluator, const string& checkpoint);
+
+        // Write the population, fitness, random state and generation to path in a compact binary format.
+        // The file is replaced atomically, so an interrupted write leaves the previous checkpoint intact
+        void save_checkpoint(const string& path) const;
+
+        // Save a checkpoint to path every interval generations while running, 0 to stop
+        void set_checkpoint(const string& path, int interval);
+
+        // Run n_gen more generations, the first call also evaluates the initial population. Returns
+        // gen, nevals, time_ms and the avg, std, min and max fitness of each generation run
+        vector<map<string, double>> run_generations(int n_gen);
+
+        int get_generation() const { return generation; }
+        int get_pop_size() const { return config.pop_size; }
+        int get_genome_bits() const { return n_bits; }
+        const GAConfig& get_config() const { return config; }
+
+        // Fitness of every organism, 0 for organisms not evaluated yet
+        vector<int> get_fitness() const { return fitness; }
+
+        // Genome of an organism as a list of bits in the order of py/gray.py, and its decoded weights
+        vector<int> get_genome(int organism) const;
+        void set_genome(int organism, const vector<int>& bits);
+        vector<int> get_weights(int organism) const;
+
+        // Best organism evaluated so far (hall of fame of size one)
+        vector<int> get_best_genome() const { return unpack(best_genome.data()); }
+        vector<int> get_best_weights() const { return decode(best_genome.data()); }
+        int get_best_fitness() const { return best_fitness; }
+
+    private:
+        OrganismEvaluator& evaluator;
+        GAConfig config;
+
+        // Genes and bits of a genome, words per genome (plus one word of padding read by decode) and the
+        // bits of each word that belong to the genome
+        int n_features, n_major;
+        int n_bits, n_words;
+        vector<uint64_t> used_bits;
+
+        // Value of each Gray code of the small and the wide bit width
+        vector<int> gray_small, gray_wide;
+
+        // pop_size genomes of n_words each. Bit i of a genome is bit 63 - i % 64 of word i / 64, so a gene
+        // reads most significant bit first, like the bit lists of py/gray.py
+        vector<uint64_t> genomes;
+        vector<int> fitness;
+        vector<char> valid;
+
+        mt19937_64 rng;
+        int generation = 0;
+        bool started = false;
+
+        vector<uint64_t> best_genome;
+        int best_fitness = -1;
+
+        string checkpoint_path;
+        int checkpoint_interval = 0;
+        void write_state(CheckpointWriter& out) const;
+        void read_state(CheckpointReader& in);
+
+        uint64_t* genome(int organism) { return &genomes[(size_t)organism * n_words]; }
+        const uint64_t* genome(int organism) const { return &genomes[(size_t)organism * n_words]; }
+        vector<int> unpack(const uint64_t* g) const;
+        vector<int> decode(const uint64_t* g) const;
+        void fix_pawn(uint64_t* g);
+
+        double uniform() { return (rng() >> 11) / 9007199254740992.0; }
+        uint64_t random_mask(double p);
+        void crossover(uint64_t* a, uint64_t* b);
+        void mutate(uint64_t* g);
+        int select_one(const vector<double>& cumulative);
+
+        // Select, cross over and mutate the next generation without evaluating it
+        void breed();
+
+        // Organisms without a valid fitness and their weights, then their fitness once evaluated
+        void collect(vector<int>& organisms, vector<vector<int>>& weights);
+        void assign(const vector<int>& organisms, const int* result);
+        void replace(int organism, const uint64_t* g, int organism_fitness, bool organism_valid);
+
+        // Evaluate every organism without a valid fitness, returns how many were evaluated
+        int evaluate();
+        map<string, double> record(int nevals, long long time_ms);
+
+        friend class IslandModel;
+};
+
+// Several GeneticAlgorithm populations (islands) evolving side by side with periodic migration of their
+// best organisms. Islands share one evaluator and advance in lockstep, so the changed organisms of every
+// island are scored together in a single evaluate_population pass over all cores
+class IslandModel {
+    public:
+        IslandModel(OrganismEvaluator& evaluator, GAConfig config, IslandConfig island_config);
+
+        // Resume every island from a checkpoint written by save_checkpoint, see GeneticAlgorithm
+        IslandModel(OrganismEvaluator& evaluator, const string& checkpoint);
+        void save_checkpoint(const string& path) const;
+        void set_checkpoint(const string& path, int interval);
+
+        // Run n_gen more generations on every island. Returns one record per island and generation, the
+        // records of GeneticAlgorithm::run_generations with an extra island index
+        vector<map<string, double>> run_generations(int n_gen);
+
+        int get_generation() const { return generation; }
+        int get_num_islands() const { return islands.size(); }
+        GeneticAlgorithm& get_island(int island) { return *islands.at(island); }
+
+        // Best organism evaluated on any island
+        vector<int> get_best_genome() const { return islands[best_island()]->get_best_genome(); }
+        vector<int> get_best_weights() const { return islands[best_island()]->get_best_weights(); }
+        int get_best_fitness() const { return islands[best_island()]->get_best_fitness(); }
+
+    private:
+        OrganismEvaluator& evaluator;
+        IslandConfig island_config;
+        vector<unique_ptr<GeneticAlgorithm>> islands;
+        int generation = 0;
+        bool started = false;
+
+        string checkpoint_path;
+        int checkpoint_interval = 0;
+
+        vector<int> evaluate();
+        void migrate();
+        int best_island() const;
+};
@@ -0,0 +1,198 @@
+#include "gradient-tuner.hpp"
+#include <cmath>
+
+GradientTuner::GradientTuner(OrganismEvaluator& evaluator, TunerConfig config)
+    : evaluator(evaluator), config(config), rng(config.seed) {
+
+    if (config.batch_size < 1) {
+        throw invalid_argument("Batch size must be positive");
+    }
+    if (config.learning_rate <= 0 or config.temperature <= 0) {
+        throw invalid_argument("Learning rate and temperature must be positive");
+    }
+    if (config.beta1 < 0 or config.beta1 >= 1 or config.beta2 < 0 or config.beta2 >= 1) {
+        throw invalid_argument("Adam decay rates must be in [0, 1)");
+    }
+    if (config.min_weight > config.max_weight) {
+        throw invalid_argument("Minimum weight is above the maximum weight");
+    }
+
+    n_features = evaluator.get_num_features();
+    pawn_index = evaluator.get_pawn_index();
+    pawn_value = evaluator.get_pawn_value();
+    for (int i = 0; i < n_features; i++) {
+        links.push_back(evaluator.get_feature_link(i));
+    }
+
+    if (config.initial_weights.empty()) {
+        weights.assign(n_features, 0);
+    } else if ((int)config.initial_weights.size() != n_features) {
+        throw invalid_argument("Expected " + to_string(n_features) + " initial weights");
+    } else {
+        weights.assign(config.initial_weights.begin(), config.initial_weights.end());
+    }
+    for (double& w : weights) {
+        w = min(max(w, (double)config.min_weight), (double)config.max_weight);
+    }
+    weights[pawn_index] = pawn_value;
+
+    m.assign(n_features, 0);
+    v.assign(n_features, 0);
+}
+
+vector<int> GradientTuner::get_weights() const {
+    vector<int> rounded(n_features);
+    for (int i = 0; i < n_features; i++) {
+        rounded[i] = (int)lround(weights[i]);
+    }
+    return rounded;
+}
+
+/* With p_r = softmax(s / T) over the successors of a position, the cross entropy of the grandmaster
+   row g is log(sum exp(s_r / T)) - s_g / T and its gradient on the effective weights is
+   (1 / T) * sum_r (p_r - [r == g]) * f_r. A linked weight adds to the effective weight of the
+   feature linked to it, so it also collects the gradient of that feature */
+double GradientTuner::gradient(const FeatureMatrix& matrix, const int* positions, int n, vector<double>& grad) const {
+    vector<double> effective(n_features);
+    for (int i = 0; i < n_features; i++) {
+        effective[i] = weights[i] + (links[i] != -1 ? weights[links[i]] : 0);
+    }
+
+    const int nf = FeatureMatrix::n_features;
+    vector<double> grad_effective(nf, 0);
+    double loss = 0;
+
+    #pragma omp parallel reduction(+:loss)
+    {
+        vector<double> local(nf, 0);
+        vector<double> scores;
+
+        #pragma omp for schedule(dynamic, 16)
+        for (int k = 0; k < n; k++) {
+            int p = positions[k];
+            int begin = matrix.segment_begin(p), end = matrix.segment_end(p);
+            int g = begin + matrix.gm_index(p);
+
+            scores.resize(end - begin);
+            double max_score = -INFINITY;
+            for (int r = begin; r < end; r++) {
+                const int16_t* fV = matrix.row(r);
+                double s = 0;
+                for (int i = 0; i < nf; i++) {
+                    s += fV[i] * effective[i];
+                }
+                scores[r - begin] = s / config.temperature;
+                max_score = max(max_score, scores[r - begin]);
+            }
+
+            // The grandmaster score is kept scaled, its exponential may underflow to 0
+            double scaled_gm = scores[g - begin];
+            double sum = 0;
+            for (double& s : scores) {
+                s = exp(s - max_score);
+                sum += s;
+            }
+            loss += log(sum) - (scaled_gm - max_score);
+
+            for (int r = begin; r < end; r++) {
+                double coefficient = (scores[r - begin] / sum - (r == g)) / config.temperature;
+                const int16_t* fV = matrix.row(r);
+                for (int i = 0; i < nf; i++) {
+                    local[i] += coefficient * fV[i];
+                }
+            }
+        }
+
+        #pragma omp critical
+        for (int i = 0; i < nf; i++) {
+            grad_effective[i] += local[i];
+        }
+    }
+
+    for (int i = 0; i < n_features; i++) {
+        grad[i] += grad_effective[i];
+        if (links[i] != -1) {
+            grad[links[i]] += grad_effective[i];
+        }
+    }
+
+    return loss;
+}
+
+/* Adam step on the mean gradient of n positions. The pawn weight is left out since it sets the scale */
+void GradientTuner::update(const vector<double>& grad, int n) {
+    step++;
+    double correction1 = 1 - pow(config.beta1, step);
+    double correction2 = 1 - pow(config.beta2, step);
+
+    for (int i = 0; i < n_features; i++) {
+        if (i == pawn_index) continue;
+
+        double g = grad[i] / n + config.l2 * weights[i];
+        m[i] = config.beta1 * m[i] + (1 - config.beta1) * g;
+        v[i] = config.beta2 * v[i] + (1 - config.beta2) * g * g;
+
+        weights[i] -= config.learning_rate * (m[i] / correction1) / (sqrt(v[i] / correction2) + config.epsilon);
+        weights[i] = min(max(weights[i], (double)config.min_weight), (double)config.max_weight);
+    }
+}
+
+int GradientTuner::count_correct(const FeatureMatrix& matrix, int n_positions) const {
+    vector<int> effective = get_weights();
+    for (int i = 0; i < n_features; i++) {
+        if (links[i] != -1) effective[i] += (int)lround(weights[links[i]]);
+    }
+
+    vector<int> positions(n_positions);
+    for (int p = 0; p < n_positions; p++) positions[p] = p;
+
+    vector<int> best;
+    matrix.select_rows(effective, positions, best);
+
+    int correct = 0;
+    for (int p = 0; p < n_positions; p++) {
+        int move = best[p] == -1 ? 0 : matrix.move(best[p]);
+        if (move == matrix.gm_move(p)) correct++;
+    }
+    return correct;
+}
+
+vector<map<string, double>> GradientTuner::run(int n_epochs) {
+    int n_positions;
+    const FeatureMatrix& matrix = evaluator.get_feature_matrix(n_positions);
+
+    // Only positions whose grandmaster move is among the legal successors carry a target
+    vector<int> positions;
+    for (int p = 0; p < n_positions; p++) {
+        if (matrix.gm_index(p) != -1) positions.push_back(p);
+    }
+    if (positions.empty()) {
+        throw runtime_error("No position with a legal grandmaster move to tune on");
+    }
+
+    vector<map<string, double>> log;
+    for (int e = 0; e < n_epochs; e++) {
+        auto start = steady_clock::now();
+        shuffle(positions.begin(), positions.end(), rng);
+
+        double loss = 0;
+        vector<double> grad(n_features);
+        for (size_t first = 0; first < positions.size(); first += config.batch_size) {
+            int n = min((size_t)config.batch_size, positions.size() - first);
+            fill(grad.begin(), grad.end(), 0);
+            loss += gradient(matrix, &positions[first], n, grad);
+            update(grad, n);
+        }
+        epoch++;
+
+        int correct = count_correct(matrix, n_positions);
+        log.push_back({
+            {"epoch", (double)epoch},
+            {"loss", loss / positions.size()},
+            {"correct", (double)correct},
+            {"time_ms", (double)duration_cast<milliseconds>(steady_clock::now() - start).count()},
+        });
+    }
+
+    return log;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "train.hpp"
+#include <random>
+
+// Settings of a GradientTuner
+struct TunerConfig {
+    // Positions per gradient step
+    int batch_size = 256;
+
+    // Adam step size (in units of weight) and moment decay rates
+    double learning_rate = 2.0;
+    double beta1 = 0.9;
+    double beta2 = 0.999;
+    double epsilon = 1e-8;
+
+    // Score difference worth one nat inside the softmax, one pawn by default
+    double temperature = 100;
+
+    // L2 penalty on the weights, per position
+    double l2 = 0;
+
+    // Weights are kept in this range, the GA only produces non-negative weights
+    int min_weight = 0;
+    int max_weight = 4095;
+
+    // Starting weights, empty to start from the pawn value alone
+    vector<int> initial_weights;
+
+    unsigned seed = 0;
+};
+
+// Tunes weights by maximizing the likelihood of the grandmaster move among the legal successors of each
+// position, with probabilities given by a softmax over the successor scores. Uses the successor feature
+// matrix of an OrganismEvaluator, so no features are extracted while tuning. Mini-batch gradients are
+// summed over all cores and applied with Adam. The pawn weight stays at the pawn value, which fixes the
+// scale of the others, and weights are rounded to integers usable by ShogiFeatures.
+class GradientTuner {
+    public:
+        GradientTuner(OrganismEvaluator& evaluator, TunerConfig config);
+
+        // Run n_epochs more passes over the positions in a random order. Returns epoch, loss (mean cross
+        // entropy), correct (grandmaster moves picked with the rounded weights) and time_ms of each epoch
+        vector<map<string, double>> run(int n_epochs);
+
+        // Current weights rounded to integers
+        vector<int> get_weights() const;
+        int get_epoch() const { return epoch; }
+
+    private:
+        OrganismEvaluator& evaluator;
+        TunerConfig config;
+
+        int n_features;
+        int pawn_index;
+        int pawn_value;
+        vector<int> links;
+
+        // Continuous weights and the Adam moment estimates
+        vector<double> weights;
+        vector<double> m, v;
+        long long step = 0;
+        int epoch = 0;
+
+        mt19937 rng;
+
+        // Adds the gradient of the summed cross entropy of the positions to grad and returns the summed loss
+        double gradient(const FeatureMatrix& matrix, const int* positions, int n, vector<double>& grad) const;
+        void update(const vector<double>& grad, int n);
+        int count_correct(const FeatureMatrix& matrix, int n_positions) const;
+};
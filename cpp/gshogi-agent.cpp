@@ -8,14 +8,14 @@ GShogiAgent::GShogiAgent(bool color, unsigned int d, vector<int> h_weights)
 }
 
 int GShogiAgent::getMove() {
-	return negamaxHelper(INT_MIN, INT_MAX);
+	// Symmetric window so negating the bounds never overflows
+	return negamaxHelper(-INT_MAX, INT_MAX);
 }
 
 // Order moves based on relative impoortance of of piece
-vector<int> GShogiAgent::orderMoves(vector<int> moves) {
+vector<int> GShogiAgent::orderMoves(Shogi& s, vector<int> moves) {
     vector<int> ordered;
     ordered.reserve(moves.size());
-    Shogi s = getBoard();
 
     for (int piece : search_order) {
         // Consider moving a regular piece first
@@ -43,7 +43,8 @@ vector<int> GShogiAgent::orderMoves(vector<int> moves) {
 
 // Helper function performs first negama call and prints stats
 int GShogiAgent::negamaxHelper(int alpha, int beta) {
-  vector<int> ordered_moves = orderMoves(getBoard().FetchMove(3));
+  Shogi root = getBoard();
+  vector<int> ordered_moves = orderMoves(root, root.FetchMove(3));
 
 	int best_move_val = INT_MIN;
 
@@ -56,13 +57,13 @@ int GShogiAgent::negamaxHelper(int alpha, int beta) {
     // Skip a move if it has been played withing buffer_size past moves. Avoid infinite games
 		if (find(played_buffer.begin(), played_buffer.end(), move) != played_buffer.end()) continue;
 
-    Shogi next = getBoard();
+    Shogi next = root;
     next.MakeMove(move);
 
 		// find value of that move
 		int value = -negamax(next, getDepth() - 1, -beta, -alpha, !getColor());
 
-		if (value == best_move_val || ordered_moves.size() <= buffer_size) {
+		if (value == best_move_val || (int)ordered_moves.size() <= buffer_size) {
 			best_moves.push_back({move, value});
 		} else if (value > best_move_val) {
 			best_move_val = value;
@@ -85,17 +86,19 @@ int GShogiAgent::negamaxHelper(int alpha, int beta) {
 
   // Edge casing in case there are no mobes
 	if (best_moves.size() == 0) {
-		cout << (getColor() ? "SENTE" : "GOTE");
-		cout << " forfeit due to having no moves.\n\n";
+		if (log_stats) {
+			cout << (getColor() ? "SENTE" : "GOTE");
+			cout << " forfeit due to having no moves.\n\n";
+		}
     return -1;
 	}
 
   // Heuristic evaluates some moves to have same value, so pick one at random
-	pair<int, int> best = best_moves[rand() % best_moves.size()];
+	pair<int, int> best = best_moves[rng() % best_moves.size()];
 	played_buffer.push_back(best.first); // add best move to buffer
 
 	// Maintain size of move buffer
-	if (played_buffer.size() > buffer_size) {
+	if ((int)played_buffer.size() > buffer_size) {
 		played_buffer.erase(played_buffer.begin());
 	}
 
@@ -111,22 +114,24 @@ int GShogiAgent::negamax(Shogi& s, unsigned int depth, int alpha, int beta, bool
 
 	int offset = (player == getColor() ? 1 : -1);
 
-	// If we reach the determined depth, return heuristic score
+	// If we reach the determined depth, return heuristic score. The heuristic is always from the
+	// agent's perspective so the window is flipped along with the score for the opponent
 	if (depth == 0) {
-      return offset * heuristic_value(s);
+      if (offset == 1) return heuristic_value(s, alpha, beta);
+      return -heuristic_value(s, -beta, -alpha);
   }
 
-	int best_value = INT_MIN;
-  vector<int> orderd_moves = orderMoves(s.FetchMove(3));
+	int best_value = -INT_MAX;
+  vector<int> orderd_moves = orderMoves(s, s.FetchMove(3));
 
 	for (int move : orderd_moves) {
-    Shogi next = getBoard();
+    Shogi next = s;
     next.MakeMove(move);
 
 		// Recursive call
 		int value = -negamax(next, depth - 1, -beta, -alpha, !player);
 
-		value = max(best_value, value);
+		best_value = max(best_value, value);
 		alpha = max(alpha, value);
 
 		if (alpha >= beta) {
@@ -135,12 +140,12 @@ int GShogiAgent::negamax(Shogi& s, unsigned int depth, int alpha, int beta, bool
     }
 	}
 
-	return beta;
+	return best_value;
 }
 
-// Use the evolved heuristic
-int GShogiAgent::heuristic_value(Shogi& s) {
-    return heuristic.evaluate(s);
+// Use the evolved heuristic, only calculating as many feature tiers as the window requires
+int GShogiAgent::heuristic_value(Shogi& s, int alpha, int beta) {
+    return heuristic.evaluate(s, alpha, beta);
 }
 
 // Output some stats as we go on, including how many times
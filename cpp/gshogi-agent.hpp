@@ -1,17 +1,26 @@
+#pragma once
 #include "agent.hpp"
 #include "features.hpp"
 #include <limits.h>
 #include <algorithm>
+#include <random>
 
 class GShogiAgent : public Agent {
 	public:
 		GShogiAgent(bool, unsigned int, vector<int> h_weights);
 		int getMove();
 
+		// Print search stats after every move
+		void setLogStats(bool log) { log_stats = log; }
+
+		// Seed of the random choice between moves with the same score
+		void setSeed(unsigned int seed) { rng.seed(seed); }
+
 	private:
 
     ShogiFeatures heuristic;
     bool log_stats = true;
+    mt19937 rng;
 		unsigned int depth;
 		unsigned int node_count = 0;
 		unsigned int prune_count = 0;
@@ -24,10 +33,10 @@ class GShogiAgent : public Agent {
     vector<int> search_order = {KING, PRO_BISHOP, PRO_ROOK, ROOK, BISHOP, PRO_PAWN, PRO_SILVER,
                                 PRO_KNIGHT, PRO_LANCE, PAWN, SILVER, KNIGHT, GOLD, LANCE, -1};
 
-    vector<int> orderMoves(vector<int> moves);
+    vector<int> orderMoves(Shogi& s, vector<int> moves);
 		int negamaxHelper(int, int);
 		int negamax(Shogi& s, unsigned int, int, int, bool);
-		int heuristic_value(Shogi& s);
+		int heuristic_value(Shogi& s, int alpha, int beta);
 		void printStats(int, int);
 
 		unsigned int getDepth();
@@ -0,0 +1,90 @@
+#include "positions.hpp"
+#include <cstring>
+
+static const char position_magic[8] = {'G', 'S', 'P', 'O', 'S', 'I', 'T', 'N'};
+
+vector<PositionRecord> positions_from_json(string json_file) {
+    ifstream fin(json_file);
+    if (fin.fail()) {
+        throw invalid_argument("Invalid file: " + json_file);
+    }
+
+    json j;
+    fin >> j;
+
+    vector<PositionRecord> positions;
+    positions.reserve(j.size());
+    for (auto& item : j) {
+        string board = item["board"];
+        vector<unsigned char> digest = load_hex_vector(board);
+        if (digest.size() != position_digest_size) {
+            throw invalid_argument("Expected a " + to_string(position_digest_size) + " byte board: " + board);
+        }
+
+        PositionRecord record;
+        memcpy(record.digest, digest.data(), position_digest_size);
+        record.gm_move = item["pmove"];
+        record.flags = 0;
+        record.flags |= movePlaying(record.gm_move) ? POSITION_DROP : 0;
+        record.flags |= moveUpgrade(record.gm_move) ? POSITION_UPGRADE : 0;
+        positions.push_back(record);
+    }
+
+    return positions;
+}
+
+void save_positions(string file, const vector<PositionRecord>& positions) {
+    PositionFileHeader header;
+    memcpy(header.magic, position_magic, sizeof(header.magic));
+    header.version = position_file_version;
+    header.n_positions = positions.size();
+
+    ofstream out(file, ios::binary);
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)positions.data(), positions.size() * sizeof(PositionRecord));
+    if (out.fail()) {
+        throw invalid_argument("Could not write positions to " + file);
+    }
+}
+
+vector<PositionRecord> load_positions(string file) {
+    ifstream fin(file, ios::binary);
+    if (fin.fail()) {
+        throw invalid_argument("Invalid file: " + file);
+    }
+
+    PositionFileHeader header;
+    fin.read((char*)&header, sizeof(header));
+    if (fin.fail() or memcmp(header.magic, position_magic, sizeof(position_magic)) != 0) {
+        throw invalid_argument("Not a position file: " + file);
+    }
+    if (header.version != position_file_version) {
+        throw invalid_argument("Unsupported position file version " + to_string(header.version) + ": " + file);
+    }
+
+    // Records are stored exactly as they are laid out in memory
+    vector<PositionRecord> positions(header.n_positions);
+    fin.read((char*)positions.data(), positions.size() * sizeof(PositionRecord));
+    if (fin.fail()) {
+        throw invalid_argument("Truncated position file: " + file);
+    }
+
+    return positions;
+}
+
+bool is_position_file(string file) {
+    ifstream fin(file, ios::binary);
+    char magic[sizeof(position_magic)];
+    fin.read(magic, sizeof(magic));
+    return !fin.fail() and memcmp(magic, position_magic, sizeof(magic)) == 0;
+}
+
+string digest_to_hex(const unsigned char* digest, int size) {
+    static const char digits[] = "0123456789ABCDEF";
+    string hex(2 * size, '0');
+    for (int i = 0; i < size; i++) {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 15];
+    }
+    return hex;
+}
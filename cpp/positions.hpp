@@ -0,0 +1,44 @@
+#pragma once
+#include "helper.hpp"
+#include "lmcache.hpp"
+#include <cstdint>
+
+/* ------------------------ Binary training position format ------------------------ */
+
+// A position file is a PositionFileHeader followed by n_positions fixed width PositionRecords, in the
+// byte order of the machine that wrote it, so the records can be read straight into memory with no
+// parsing. Files are converted from the json samples ({board, pmove} pairs) with convert-positions.
+
+// Size of the digest produced by Shogi::SaveGame (board, pieces in hand, round)
+const int position_digest_size = 99;
+
+// Flags describing the grandmaster move of a position
+const uint8_t POSITION_DROP = 1;
+const uint8_t POSITION_UPGRADE = 2;
+
+struct PositionRecord {
+    unsigned char digest[position_digest_size];
+    uint8_t flags;
+    int32_t gm_move;
+};
+static_assert(sizeof(PositionRecord) == 104, "PositionRecord must not contain padding");
+
+struct PositionFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_positions;
+};
+
+const uint32_t position_file_version = 1;
+
+// Read a json sample of {board : hex digest, pmove : grandmaster move} objects
+vector<PositionRecord> positions_from_json(string json_file);
+
+void save_positions(string file, const vector<PositionRecord>& positions);
+vector<PositionRecord> load_positions(string file);
+
+// True if the file starts with the position file magic (as opposed to a json sample)
+bool is_position_file(string file);
+
+// Upper case hex string of a digest, the board format used by the json samples and legal moves cache
+string digest_to_hex(const unsigned char* digest, int size);
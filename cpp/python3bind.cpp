@@ -1,10 +1,44 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
 #include "train.hpp"
+#include "genetic-algorithm.hpp"
+#include "gradient-tuner.hpp"
+#include "spsa-tuner.hpp"
 #include "organism-game.hpp"
 
 namespace py = pybind11;
 
+// C contiguous int32 numpy arrays. Without py::array::forcecast the overloads below only match arrays
+// that already have this layout, so the buffer is read in place instead of element by element
+using IntArray = py::array_t<int32_t, py::array::c_style>;
+
+static vector<int> organism_weights(const IntArray& weights) {
+    if (weights.ndim() != 1) {
+        throw invalid_argument("Expected a 1-D array of weights");
+    }
+    return vector<int>(weights.data(), weights.data() + weights.shape(0));
+}
+
+static vector<vector<int>> population_weights(const IntArray& population) {
+    if (population.ndim() != 2) {
+        throw invalid_argument("Expected a 2-D array of weights, one organism per row");
+    }
+    vector<vector<int>> rows(population.shape(0));
+    for (size_t o = 0; o < rows.size(); o++) {
+        const int32_t* row = population.data(o, 0);
+        rows[o].assign(row, row + population.shape(1));
+    }
+    return rows;
+}
+
+static int32_t* output_buffer(IntArray& out, size_t size, const string& name) {
+    if (out.ndim() != 1 or (size_t)out.shape(0) != size) {
+        throw invalid_argument("Expected " + name + " to be a 1-D array of size " + to_string(size));
+    }
+    return out.mutable_data();
+}
+
 // Define the functions usable for the python module
 PYBIND11_MODULE(GeneticShogi, m) {
     m.doc() = "Python3 package for Shogi agent based on genetic algorithms";
@@ -13,6 +47,8 @@ PYBIND11_MODULE(GeneticShogi, m) {
     // Organism evaluator class
     py::class_<OrganismEvaluator>(m, "OrganismEvaluator")
         .def(py::init<>())
+        .def(py::init<string, string, string>(), py::arg("train_file"), py::arg("test_file"),
+             py::arg("moves_file"))
         .def("set_mode", &OrganismEvaluator::set_mode)
         .def("get_mode", &OrganismEvaluator::get_mode)
         .def("set_num_eval", &OrganismEvaluator::set_num_eval)
@@ -20,8 +56,160 @@ PYBIND11_MODULE(GeneticShogi, m) {
         .def("get_num_features", &OrganismEvaluator::get_num_features)
         .def("get_feature_labels", &OrganismEvaluator::get_feature_labels)
         .def("get_num_major_features", &OrganismEvaluator::get_num_major_features)
+        .def("get_position_features", &OrganismEvaluator::get_position_features)
+        .def("evaluate_organism", [](OrganismEvaluator& evaluator, IntArray weights) {
+            vector<int> w = organism_weights(weights);
+            py::gil_scoped_release release;
+            return evaluator.evaluate_organism(w);
+        })
         .def("evaluate_organism", &OrganismEvaluator::evaluate_organism)
-        .def("get_evaluation_stats", &OrganismEvaluator::get_evaluation_stats);
+        .def("evaluate_racing", &OrganismEvaluator::evaluate_racing, py::arg("weights"), py::arg("threshold"),
+             py::call_guard<py::gil_scoped_release>())
+        .def("evaluate_population", [](OrganismEvaluator& evaluator, IntArray population, IntArray fitness) {
+            vector<vector<int>> rows = population_weights(population);
+            int32_t* out = output_buffer(fitness, rows.size(), "fitness");
+            vector<int> result;
+            {
+                py::gil_scoped_release release;
+                result = evaluator.evaluate_population(rows);
+            }
+            copy(result.begin(), result.end(), out);
+        }, py::arg("population"), py::arg("fitness"))
+        .def("evaluate_population", &OrganismEvaluator::evaluate_population)
+        .def("evaluate_ranks", [](OrganismEvaluator& evaluator, vector<int> weights) {
+            return evaluator.evaluate_ranks(weights).values;
+        }, py::call_guard<py::gil_scoped_release>())
+        .def("evaluate_population_ranks", [](OrganismEvaluator& evaluator, vector<vector<int>> population) {
+            vector<array<double, N_RANK_CATEGORIES * N_RANK_METRICS>> result;
+            for (const RankStats& ranks : evaluator.evaluate_population_ranks(population)) {
+                result.push_back(ranks.values);
+            }
+            return result;
+        }, py::call_guard<py::gil_scoped_release>())
+        .def("get_rank_labels", &OrganismEvaluator::get_rank_labels)
+        .def("set_batch", &OrganismEvaluator::set_batch, py::arg("batch_size"), py::arg("seed") = 0)
+        .def("get_batch_size", &OrganismEvaluator::get_batch_size)
+        .def("set_generation", &OrganismEvaluator::set_generation)
+        .def("get_generation", &OrganismEvaluator::get_generation)
+        .def("get_batch", &OrganismEvaluator::get_batch)
+        .def("get_evaluation_stats", [](OrganismEvaluator& evaluator, IntArray out) {
+            const EvaluationStats& stats = evaluator.get_evaluation_counts();
+            int32_t* counts = output_buffer(out, N_EVALUATION_STATS, "stats");
+            copy(stats.counts.begin(), stats.counts.end(), counts);
+        }, py::arg("out"))
+        .def("get_evaluation_stats", &OrganismEvaluator::get_evaluation_stats)
+        .def("get_evaluation_stat_labels", &OrganismEvaluator::get_evaluation_stat_labels)
+        .def("get_cache_stats", &OrganismEvaluator::get_cache_stats)
+        .def("set_memo_capacity", &OrganismEvaluator::set_memo_capacity)
+        .def("get_memo_capacity", &OrganismEvaluator::get_memo_capacity)
+        .def("share", &OrganismEvaluator::share)
+        .def("attach", &OrganismEvaluator::attach)
+        .def("is_attached", &OrganismEvaluator::is_attached)
+        .def("evaluate_shard", &OrganismEvaluator::evaluate_shard, py::arg("population"), py::arg("shard"),
+             py::arg("n_shards"), py::call_guard<py::gil_scoped_release>())
+        .def("set_native_moves", &OrganismEvaluator::set_native_moves)
+        .def("get_native_moves", &OrganismEvaluator::get_native_moves)
+        .def("verify_native_moves", &OrganismEvaluator::verify_native_moves)
+        .def("set_cache_dir", &OrganismEvaluator::set_cache_dir)
+        .def("get_cache_dir", &OrganismEvaluator::get_cache_dir)
+        .def("set_profiling", &OrganismEvaluator::set_profiling)
+        .def("get_profile", &OrganismEvaluator::get_profile);
+
+    // Settings and driver of the native genetic algorithm
+    py::class_<GAConfig>(m, "GAConfig")
+        .def(py::init<>())
+        .def_readwrite("pop_size", &GAConfig::pop_size)
+        .def_readwrite("cxpb", &GAConfig::cxpb)
+        .def_readwrite("mutpb", &GAConfig::mutpb)
+        .def_readwrite("cx_indpb", &GAConfig::cx_indpb)
+        .def_readwrite("mut_indpb", &GAConfig::mut_indpb)
+        .def_readwrite("bit_width_small", &GAConfig::bit_width_small)
+        .def_readwrite("bit_width_wide", &GAConfig::bit_width_wide)
+        .def_readwrite("selection", &GAConfig::selection)
+        .def_readwrite("tournament_size", &GAConfig::tournament_size)
+        .def_readwrite("pawn_value", &GAConfig::pawn_value)
+        .def_readwrite("seed", &GAConfig::seed);
+
+    // Keeps the evaluator alive for as long as the genetic algorithm uses it
+    py::class_<GeneticAlgorithm>(m, "GeneticAlgorithm")
+        .def(py::init<OrganismEvaluator&, GAConfig>(), py::keep_alive<1, 2>())
+        .def(py::init<OrganismEvaluator&, const string&>(), py::keep_alive<1, 2>())
+        .def("run_generations", &GeneticAlgorithm::run_generations, py::call_guard<py::gil_scoped_release>())
+        .def("save_checkpoint", &GeneticAlgorithm::save_checkpoint)
+        .def("set_checkpoint", &GeneticAlgorithm::set_checkpoint)
+        .def("get_generation", &GeneticAlgorithm::get_generation)
+        .def("get_pop_size", &GeneticAlgorithm::get_pop_size)
+        .def("get_genome_bits", &GeneticAlgorithm::get_genome_bits)
+        .def("get_fitness", &GeneticAlgorithm::get_fitness)
+        .def("get_genome", &GeneticAlgorithm::get_genome)
+        .def("set_genome", &GeneticAlgorithm::set_genome)
+        .def("get_weights", &GeneticAlgorithm::get_weights)
+        .def("get_best_genome", &GeneticAlgorithm::get_best_genome)
+        .def("get_best_weights", &GeneticAlgorithm::get_best_weights)
+        .def("get_best_fitness", &GeneticAlgorithm::get_best_fitness);
+
+    py::class_<IslandConfig>(m, "IslandConfig")
+        .def(py::init<>())
+        .def_readwrite("n_islands", &IslandConfig::n_islands)
+        .def_readwrite("migration_interval", &IslandConfig::migration_interval)
+        .def_readwrite("n_migrants", &IslandConfig::n_migrants)
+        .def_readwrite("topology", &IslandConfig::topology);
+
+    py::class_<IslandModel>(m, "IslandModel")
+        .def(py::init<OrganismEvaluator&, GAConfig, IslandConfig>(), py::keep_alive<1, 2>())
+        .def(py::init<OrganismEvaluator&, const string&>(), py::keep_alive<1, 2>())
+        .def("run_generations", &IslandModel::run_generations, py::call_guard<py::gil_scoped_release>())
+        .def("save_checkpoint", &IslandModel::save_checkpoint)
+        .def("set_checkpoint", &IslandModel::set_checkpoint)
+        .def("get_generation", &IslandModel::get_generation)
+        .def("get_num_islands", &IslandModel::get_num_islands)
+        .def("get_island", &IslandModel::get_island, py::return_value_policy::reference_internal)
+        .def("get_best_genome", &IslandModel::get_best_genome)
+        .def("get_best_weights", &IslandModel::get_best_weights)
+        .def("get_best_fitness", &IslandModel::get_best_fitness);
+
+    // Move prediction tuning by gradient descent on the successor feature matrix
+    py::class_<TunerConfig>(m, "TunerConfig")
+        .def(py::init<>())
+        .def_readwrite("batch_size", &TunerConfig::batch_size)
+        .def_readwrite("learning_rate", &TunerConfig::learning_rate)
+        .def_readwrite("beta1", &TunerConfig::beta1)
+        .def_readwrite("beta2", &TunerConfig::beta2)
+        .def_readwrite("epsilon", &TunerConfig::epsilon)
+        .def_readwrite("temperature", &TunerConfig::temperature)
+        .def_readwrite("l2", &TunerConfig::l2)
+        .def_readwrite("min_weight", &TunerConfig::min_weight)
+        .def_readwrite("max_weight", &TunerConfig::max_weight)
+        .def_readwrite("initial_weights", &TunerConfig::initial_weights)
+        .def_readwrite("seed", &TunerConfig::seed);
+
+    py::class_<GradientTuner>(m, "GradientTuner")
+        .def(py::init<OrganismEvaluator&, TunerConfig>(), py::keep_alive<1, 2>())
+        .def("run", &GradientTuner::run, py::call_guard<py::gil_scoped_release>())
+        .def("get_weights", &GradientTuner::get_weights)
+        .def("get_epoch", &GradientTuner::get_epoch);
+
+    // Game strength tuning by SPSA over parallel self-play games
+    py::class_<SPSAConfig>(m, "SPSAConfig")
+        .def(py::init<>())
+        .def_readwrite("pairs_per_iteration", &SPSAConfig::pairs_per_iteration)
+        .def_readwrite("c", &SPSAConfig::c)
+        .def_readwrite("a", &SPSAConfig::a)
+        .def_readwrite("A", &SPSAConfig::A)
+        .def_readwrite("alpha", &SPSAConfig::alpha)
+        .def_readwrite("gamma", &SPSAConfig::gamma)
+        .def_readwrite("search_depth", &SPSAConfig::search_depth)
+        .def_readwrite("max_round", &SPSAConfig::max_round)
+        .def_readwrite("min_weight", &SPSAConfig::min_weight)
+        .def_readwrite("max_weight", &SPSAConfig::max_weight)
+        .def_readwrite("seed", &SPSAConfig::seed);
+
+    py::class_<SPSATuner>(m, "SPSATuner")
+        .def(py::init<vector<int>, SPSAConfig>())
+        .def("run", &SPSATuner::run, py::call_guard<py::gil_scoped_release>())
+        .def("get_weights", &SPSATuner::get_weights)
+        .def("get_iteration", &SPSATuner::get_iteration)
+        .def_static("play_game", &SPSATuner::play_game, py::call_guard<py::gil_scoped_release>());
 
     // Class to play games between two organisms
     py::class_<OrganismGame>(m, "OrganismGame")
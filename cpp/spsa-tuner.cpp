@@ -0,0 +1,115 @@
+#include "spsa-tuner.hpp"
+#include <chrono>
+#include <cmath>
+
+using namespace std::chrono;
+
+SPSATuner::SPSATuner(vector<int> initial, SPSAConfig config) : config(config), rng(config.seed) {
+    if (config.pairs_per_iteration < 1) {
+        throw invalid_argument("Need at least one game pair per iteration");
+    }
+    if (config.c <= 0 or config.a <= 0) {
+        throw invalid_argument("Perturbation and step size must be positive");
+    }
+    if (config.search_depth < 1 or config.max_round < 1) {
+        throw invalid_argument("Search depth and max round must be positive");
+    }
+    if (config.min_weight > config.max_weight) {
+        throw invalid_argument("Minimum weight is above the maximum weight");
+    }
+    if ((int)initial.size() != FeatureConfig::n_features) {
+        throw invalid_argument("Expected " + to_string(FeatureConfig::n_features) + " weights");
+    }
+
+    pawn_index = ShogiFeatures(0).getPawnIndex();
+    weights.assign(initial.begin(), initial.end());
+}
+
+vector<int> SPSATuner::get_weights() const {
+    vector<int> rounded(weights.size());
+    for (size_t i = 0; i < weights.size(); i++) {
+        rounded[i] = (int)lround(weights[i]);
+    }
+    return rounded;
+}
+
+vector<int> SPSATuner::perturbed(const vector<int>& delta, double scale) const {
+    vector<int> w(weights.size());
+    for (size_t i = 0; i < weights.size(); i++) {
+        double value = min(max(weights[i] + scale * delta[i], (double)config.min_weight), (double)config.max_weight);
+        w[i] = (int)lround(value);
+    }
+    return w;
+}
+
+int SPSATuner::play_game(const vector<int>& sente_weights, const vector<int>& gote_weights,
+                         int search_depth, int max_round, unsigned seed) {
+    GShogiAgent sente(0, search_depth, sente_weights);
+    GShogiAgent gote(1, search_depth, gote_weights);
+    sente.setLogStats(false);
+    gote.setLogStats(false);
+    sente.setSeed(seed);
+    gote.setSeed(seed + 1);
+
+    Shogi s;
+    s.Init();
+    Game g(s, &sente, &gote, false);
+    return g.play(max_round);
+}
+
+vector<map<string, double>> SPSATuner::run(int n_iter) {
+    vector<map<string, double>> log;
+
+    for (int k = 0; k < n_iter; k++) {
+        auto start = steady_clock::now();
+
+        double c_k = config.c / pow(iteration + 1, config.gamma);
+        double a_k = config.a / pow(iteration + 1 + config.A, config.alpha);
+
+        vector<int> delta(weights.size());
+        for (size_t i = 0; i < weights.size(); i++) {
+            delta[i] = (int)i == pawn_index ? 0 : (rng() & 1 ? 1 : -1);
+        }
+        vector<int> plus = perturbed(delta, c_k);
+        vector<int> minus = perturbed(delta, -c_k);
+
+        // Game 2p has the plus weights as sente and game 2p + 1 as gote, each game with its own seed
+        int n_games = 2 * config.pairs_per_iteration;
+        vector<unsigned> seeds(n_games);
+        for (unsigned& seed : seeds) seed = rng();
+
+        int plus_wins = 0, minus_wins = 0, draws = 0;
+        #pragma omp parallel for schedule(dynamic) reduction(+:plus_wins,minus_wins,draws)
+        for (int game = 0; game < n_games; game++) {
+            bool plus_sente = game % 2 == 0;
+            int winner = plus_sente ? play_game(plus, minus, config.search_depth, config.max_round, seeds[game])
+                                    : play_game(minus, plus, config.search_depth, config.max_round, seeds[game]);
+            if (winner == -1) {
+                draws++;
+            } else if ((winner == 0) == plus_sente) {
+                plus_wins++;
+            } else {
+                minus_wins++;
+            }
+        }
+
+        // Mean score difference per game, in [-1, 1], over twice the perturbation estimates the gradient
+        double result = (double)(plus_wins - minus_wins) / n_games;
+        double step = a_k * result / (2 * c_k);
+        for (size_t i = 0; i < weights.size(); i++) {
+            weights[i] = min(max(weights[i] + step * delta[i], (double)config.min_weight), (double)config.max_weight);
+        }
+        iteration++;
+
+        log.push_back({
+            {"iteration", (double)iteration},
+            {"plus_wins", (double)plus_wins},
+            {"minus_wins", (double)minus_wins},
+            {"draws", (double)draws},
+            {"step", step},
+            {"time_ms", (double)duration_cast<milliseconds>(steady_clock::now() - start).count()},
+        });
+    }
+
+    return log;
+}
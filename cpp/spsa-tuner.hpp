@@ -0,0 +1,60 @@
+#pragma once
+#include "game.hpp"
+#include "gshogi-agent.hpp"
+#include <map>
+#include <random>
+
+// Settings of an SPSATuner. Gains follow the usual SPSA schedules, at iteration k the perturbation is
+// c / (k + 1)^gamma and the step size a / (k + 1 + A)^alpha
+struct SPSAConfig {
+    // Game pairs per iteration, each pair plays the two perturbed weight vectors once with either color
+    int pairs_per_iteration = 8;
+
+    // Perturbation scale in units of weight, step size and their decay
+    double c = 10;
+    double a = 50;
+    double A = 10;
+    double alpha = 0.602;
+    double gamma = 0.101;
+
+    // Search depth of both agents and the round at which a game is scored a draw
+    int search_depth = 2;
+    int max_round = 256;
+
+    // Weights are kept in this range, the pawn weight stays at its starting value
+    int min_weight = 0;
+    int max_weight = 4095;
+
+    unsigned seed = 0;
+};
+
+// Tunes weights for game strength by simultaneous perturbation stochastic approximation. Each iteration
+// draws a random +-1 direction, plays agents using the weights moved c_k along it against agents moved
+// c_k the opposite way, and steps the weights by the game score difference divided by the perturbation.
+// The games of an iteration are independent and are played in parallel over all cores
+class SPSATuner {
+    public:
+        SPSATuner(vector<int> weights, SPSAConfig config);
+
+        // Run n_iter more iterations. Returns iteration, plus_wins, minus_wins, draws, step and time_ms
+        // of each iteration
+        vector<map<string, double>> run(int n_iter);
+
+        // Current weights rounded to integers
+        vector<int> get_weights() const;
+        int get_iteration() const { return iteration; }
+
+        // Play one game without printing anything. Returns 0 if sente wins, 1 if gote wins, -1 for a draw
+        static int play_game(const vector<int>& sente_weights, const vector<int>& gote_weights,
+                             int search_depth, int max_round, unsigned seed);
+
+    private:
+        SPSAConfig config;
+        vector<double> weights;
+        int pawn_index;
+        int iteration = 0;
+
+        mt19937 rng;
+
+        vector<int> perturbed(const vector<int>& delta, double scale) const;
+};
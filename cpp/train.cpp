@@ -1,26 +1,179 @@
 #include "train.hpp"
 #include "json.hpp"
 #include <string>
+#include <sstream>
+#include <iterator>
+#include <random>
 
 #define DEBUG 0
 
-OrganismEvaluator::OrganismEvaluator() : heuristic(SENTE){
-	// Load the cache of legal moves into memory
-	cache.Init(lm_cache);
+OrganismEvaluator::OrganismEvaluator() : OrganismEvaluator(STR(TRAIN_FILE), STR(TEST_FILE), STR(MOVES_FILE)) {}
 
-	// Set the default number of evaluations to size of train data
-	n_eval = n_train;
+OrganismEvaluator::OrganismEvaluator(string train_file, string test_file, string moves_file)
+	: heuristic(SENTE), train_file(train_file), test_file(test_file), lm_cache(moves_file) {
+
+	// Default to evaluating every position of the sample once it is loaded
+	n_eval = 0;
 
 	// Default mode is train mode
 	mode = train_mode;
-	sample = train_data;
 
 	// Keep logging to stats object off by default
 	log = true;
+
+	// Save feature matrices next to the moves cache they were built from
+	size_t slash = lm_cache.rfind('/');
+	matrix_cache_dir = slash == string::npos ? "." : lm_cache.substr(0, slash);
+
+	init_profile();
+}
+
+void OrganismEvaluator::init_profile() {
+	// Feature functions first, followed by the stages of building the feature matrix and of scoring it
+	profile_labels = heuristic.profile_labels();
+
+	profile_load_board = profile_labels.size();
+	profile_labels.push_back("load_board");
+	profile_make_move = profile_labels.size();
+	profile_labels.push_back("make_move");
+	profile_cache_lookup = profile_labels.size();
+	profile_labels.push_back("feature_cache_lookup");
+	profile_attack_map = profile_labels.size();
+	profile_labels.push_back("attack_map");
+	profile_scoring = profile_labels.size();
+	profile_labels.push_back("scoring");
+
+	profile.reset(profile_labels.size());
+}
+
+void OrganismEvaluator::set_profiling(bool enabled) {
+	// Always start from a clean profile when toggling
+	profiling = enabled;
+	profile.reset(profile_labels.size());
+}
+
+map<string, pair<long long, long long>> OrganismEvaluator::get_profile() {
+	map<string, pair<long long, long long>> result;
+	for (size_t i = 0; i < profile_labels.size(); i++) {
+		result[profile_labels[i]] = {profile.nanos[i], profile.calls[i]};
+	}
+	return result;
+}
+
+map<string, long long> OrganismEvaluator::get_cache_stats() {
+	return {
+		{"entries", (long long)feature_tt.size()},
+		{"capacity", (long long)feature_tt.capacity()},
+		{"hits", feature_tt.get_hits()},
+		{"misses", feature_tt.get_misses()},
+		{"collisions", feature_tt.get_collisions()},
+		{"memo_entries", (long long)memo.size()},
+		{"memo_hits", memo_hits},
+		{"memo_misses", memo_misses}
+	};
+}
+
+void OrganismEvaluator::set_memo_capacity(int capacity) {
+	if (capacity < 0) {
+		throw invalid_argument("Memo capacity must be positive, or 0 to disable it.");
+	}
+	memo_capacity = capacity;
+	memo_clear();
+}
+
+uint64_t OrganismEvaluator::memo_key(const vector<int>& weights) {
+	// FNV-1a over the weights and everything that selects the positions they are scored on
+	uint64_t h = 1469598103934665603ULL;
+	auto mix = [&h](const void* data, size_t size) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++) {
+			h ^= bytes[i];
+			h *= 1099511628211ULL;
+		}
+	};
+
+	mix(&n_eval, sizeof(n_eval));
+	mix(&batch_size, sizeof(batch_size));
+	if (batch_size > 0) {
+		mix(&batch_seed, sizeof(batch_seed));
+		mix(&generation, sizeof(generation));
+	}
+	mix(weights.data(), weights.size() * sizeof(int));
+	return h;
+}
+
+const OrganismEvaluator::MemoEntry* OrganismEvaluator::memo_find(const vector<int>& weights, uint64_t key, bool full_stats) {
+	if (memo_capacity == 0) return nullptr;
+
+	// An entry holding only totals cannot stand in for an evaluation that reports per move stats
+	auto itr = memo.find(key);
+	if (itr == memo.end() or itr->second.weights != weights or (full_stats and !itr->second.full_stats)) {
+		memo_misses++;
+		return nullptr;
+	}
+	memo_hits++;
+	return &itr->second;
+}
+
+void OrganismEvaluator::memo_insert(const vector<int>& weights, uint64_t key, int fitness, bool full_stats) {
+	if (memo_capacity == 0) return;
+
+	auto itr = memo.find(key);
+	if (itr == memo.end()) {
+		// Forget the oldest organism once full
+		if ((int)memo.size() >= memo_capacity) {
+			memo.erase(memo_order.front());
+			memo_order.pop_front();
+		}
+		memo_order.push_back(key);
+		itr = memo.insert({key, MemoEntry()}).first;
+	}
+	itr->second.weights = weights;
+	itr->second.fitness = fitness;
+	itr->second.stats = stats;
+	itr->second.full_stats = full_stats;
+}
+
+void OrganismEvaluator::memo_clear() {
+	memo.clear();
+	memo_order.clear();
+}
+
+void OrganismEvaluator::load_moves_cache() {
+	if (!moves_loaded and !native_moves) {
+		cache.Init(lm_cache);
+		moves_loaded = true;
+	}
+}
+
+void OrganismEvaluator::load_sample() {
+	if (sample_loaded) return;
+	if (attached) {
+		throw runtime_error("Evaluator is attached to a shared feature matrix and has no dataset loaded");
+	}
+
+	if (mode == test_mode) {
+		if (test_data.empty()) test_data = loadGames(test_file);
+		sample = test_data;
+	} else {
+		if (train_data.empty()) train_data = loadGames(train_file);
+		sample = train_data;
+	}
+	sample_loaded = true;
+
+	// Evaluate the whole sample unless a smaller number was asked for
+	if (n_eval == 0 or n_eval > (int)sample.size()) {
+		n_eval = sample.size();
+	}
 }
 
 void OrganismEvaluator::set_num_eval(int num_eval) {
-	int bound = mode == train_mode ? n_train : n_test;
+	// An attached evaluator can only score the positions the shared matrix was built from
+	int bound = matrix_scanned;
+	if (!attached) {
+		load_sample();
+		bound = sample.size();
+	}
 	if (num_eval <= 0) {
 			throw invalid_argument("Positions to evaluate must be non-zero.");
 	}
@@ -37,9 +190,15 @@ void OrganismEvaluator::set_mode(string mode_string) {
 	}
 	// Careful with tt cache when switching between modes
 	feature_tt.clear();
+	memo_clear();
 	tt_full = false;
-	sample = mode == train_mode ? train_data : test_data;
+	attached = false;
+	matrix.clear();
+	square_pieces.clear();
+	matrix_scanned = 0;
+	matrix_key = 0;
 	mode = mode_string;
+	sample_loaded = false;
 }
 
 Shogi OrganismEvaluator::load_game(string board) {
@@ -51,167 +210,599 @@ Shogi OrganismEvaluator::load_game(string board) {
 	return s;
 }
 
-/* Function to return best move based on heuristic synchronously */
-int OrganismEvaluator::select_move(string board, vector<int> weights, int& pos) {
+Shogi OrganismEvaluator::load_game(const vector<unsigned char>& digest) {
+	Shogi s;
+	s.Init();
+	s.LoadGame(digest);
 
+	return s;
+}
 
-	// Initialize shogi object based on board and best score / move to 0
+pair<vector<int>, vector<int>> OrganismEvaluator::get_position_features(string board) {
 	Shogi s = load_game(board);
-	int best_score = INT_MIN, best_move = 0;
-
-	// Set the perspective for the heuristic evaluation to current player for the input board
-  int player = (s.round % 2);
-	heuristic.setPlayer(player);
-
-	if (DEBUG) {
-		cout << "----------------------------------------" << endl;
-		string curr = player == SENTE ? "Sente" : "Gote";
-		cout << "Player: " << curr << endl;
-		cout << "Starting position:" << endl;
-		s.EasyBoardPrint();
-	}
-
-	// Loop though all possible moves reachable from board state
-	int hits = 0;
-	for (auto &action : cache.legal_moves[board]) {
-
-		int move = action.first;
-
-		// Initialize new board and make the move
-		Shogi result = s;
-		result.MakeMove(move);
-
-		// Print the board in debug mode
-		/* if (DEBUG) { */
-		/* 	cout << "----------------------------------------" << endl; */
-		/* 	string curr = player == SENTE ? "Sente" : "Gote"; */
-		/* 	cout << "Player: " << curr << endl; */
-		/* 	cout << "Starting position:" << endl; */
-		/* 	s.EasyBoardPrint(); */
-		/* 	cout << "Looking at first available move: "; */
-		/* 	printMove(move); */
-		/* 	cout << "Result:" << endl; */
-		/* 	result.EasyBoardPrint(); */
-		/* 	cout << endl; */
-		/* } */
 
-		// Key used for the transposition table of {pos, featureVector}
-		vector<unsigned char> result_state = result.SaveGame();
-		vector<int> fV;
+	// Update attack map needed in heuristic calculations
+	s.FetchMove(1);
 
-		// Use the feature vector saved in the transposition table if game_state already seen
-		if (feature_tt.count(result_state)) {
-			fV = feature_tt.at(result_state);
-		} else {
-			// Update attack map needed in heuristic calculations
-			result.FetchMove(1);
+	FeatureScratch sente, gote;
+	return heuristic.feature_vecs_raw(s, sente, gote);
+}
 
-			// First time seeing game state, add {pos, featureVector} to transposition table
-			fV = heuristic.feature_vec_raw(result);
-			feature_tt.insert({result_state, fV});
+/* Legal moves of a board (s is the loaded board), from the cache or generated by the shogi engine */
+vector<int> OrganismEvaluator::legal_moves(const string& board, Shogi& s) {
+	if (native_moves) {
+		return s.FetchMove(3);
+	}
+
+	vector<int> moves;
+	auto itr = cache.legal_moves.find(board);
+	if (itr != cache.legal_moves.end()) {
+		for (auto& action : itr->second) {
+			moves.push_back(action.first);
 		}
+	}
+	return moves;
+}
+
+void OrganismEvaluator::set_native_moves(bool native) {
+	if (native == native_moves) return;
 
-    // Initialize score with pawn value and accumulate other features with weights
-		int score = heuristic.evaluate_feature_vec(fV, weights);
+	// Successor rows follow the order of the legal moves, so the matrix has to be rebuilt
+	native_moves = native;
+	memo_clear();
+	tt_full = false;
+	attached = false;
+	matrix.clear();
+	square_pieces.clear();
+	matrix_scanned = 0;
+	matrix_key = 0;
+}
 
-		// Print the raw feature vector in debug mode
-		/* if (DEBUG) { */
-		/* 	print_vec(fV); */
-		/* 	cout << "Score: " << score << endl; */
-		/* 	cout << endl; */
+map<string, int> OrganismEvaluator::verify_native_moves() {
+	load_sample();
+	if (!moves_loaded) {
+		cache.Init(lm_cache);
+		moves_loaded = true;
+	}
 
-		/* 	// Break from the loop after looking at one move */
-		/* 	/1* break; *1/ */
-		/* } */
+	map<string, int> result = {
+		{"positions", 0}, {"matching", 0}, {"not_in_cache", 0}, {"missing_moves", 0}, {"extra_moves", 0}
+	};
+
+	for (int i = 0; i < n_eval; i++) {
+		result["positions"] += 1;
+
+		auto itr = cache.legal_moves.find(sample[i].board);
+		if (itr == cache.legal_moves.end()) {
+			result["not_in_cache"] += 1;
+			continue;
+		}
+
+		vector<int> cached;
+		for (auto& action : itr->second) {
+			cached.push_back(action.first);
+		}
+		vector<int> generated = load_game(sample[i].digest).FetchMove(3);
+		sort(cached.begin(), cached.end());
+		sort(generated.begin(), generated.end());
+
+		// Moves the cache lists but the engine does not generate, and the other way around
+		vector<int> missing, extra;
+		set_difference(cached.begin(), cached.end(), generated.begin(), generated.end(), back_inserter(missing));
+		set_difference(generated.begin(), generated.end(), cached.begin(), cached.end(), back_inserter(extra));
+
+		result["missing_moves"] += missing.size();
+		result["extra_moves"] += extra.size();
+		result["matching"] += (missing.empty() and extra.empty()) ? 1 : 0;
+	}
+
+	return result;
+}
+
+/* Hash identifying the current sample, mode, legal moves and feature set */
+uint64_t OrganismEvaluator::data_key() {
+	if (matrix_key == 0) {
+		// The key covers the sample and the cached legal moves, both have to be loaded before hashing
+		load_sample();
+		load_moves_cache();
+
+		// FNV-1a over everything the matrix depends on
+		uint64_t h = 1469598103934665603ULL;
+		auto mix = [&h](const void* data, size_t size) {
+			const unsigned char* bytes = (const unsigned char*)data;
+			for (size_t i = 0; i < size; i++) {
+				h ^= bytes[i];
+				h *= 1099511628211ULL;
+			}
+		};
+
+		int n_features = heuristic.num_features();
+		mix(&n_features, sizeof(n_features));
+		for (const string& label : heuristic.features_vec_labels()) {
+			mix(label.data(), label.size() + 1);
+		}
+
+		// Drop mode only keeps positions where the grandmaster dropped a piece
+		bool drops_only = mode == train_drops;
+		mix(&drops_only, sizeof(drops_only));
+
+		// Generated moves are determined by the board, so only cached moves need to be part of the key
+		mix(&native_moves, sizeof(native_moves));
+
+		for (auto& game : sample) {
+			mix(game.board.data(), game.board.size() + 1);
+			mix(&game.pmove, sizeof(game.pmove));
+
+			auto itr = cache.legal_moves.find(game.board);
+			if (!native_moves and itr != cache.legal_moves.end()) {
+				for (auto& action : itr->second) {
+					mix(&action.first, sizeof(action.first));
+				}
+			}
+			int end = -1;
+			mix(&end, sizeof(end));
+		}
 
+		matrix_key = h == 0 ? 1 : h;
+	}
+	return matrix_key;
+}
+
+/* Path of the saved feature matrix for the current sample, mode and feature set */
+string OrganismEvaluator::matrix_file() {
+	stringstream name;
+	name << matrix_cache_dir << "/feature_matrix_" << hex << setw(16) << setfill('0') << data_key() << ".bin";
+	return name.str();
+}
+
+/* Extend the successor feature matrix to cover the first n_eval positions of the sample */
+void OrganismEvaluator::build_matrix() {
+	// Shared matrices are complete, attached evaluators never extract features
+	if (attached) return;
+
+	load_sample();
+	load_moves_cache();
+
+	// Warm start from a matrix saved by an earlier run on the same data
+	if (matrix_scanned == 0 and !matrix_cache_dir.empty()) {
+		// The path computes the key, so it has to be built before the key is read
+		string path = matrix_file();
+		int scanned = 0;
+		if (matrix.load(path, data_key(), scanned)) {
+			matrix_scanned = scanned;
+		}
+	}
+	if (matrix_scanned >= n_eval) return;
+
+	// Every successor of the new positions may need an entry, size the transposition table up front.
+	// Generated moves are not known in advance, the table grows as needed instead
+	if (!native_moves) {
+		size_t successors = 0;
+		for (int i = matrix_scanned; i < n_eval; i++) {
+			auto itr = cache.legal_moves.find(sample[i].board);
+			if (itr != cache.legal_moves.end()) successors += itr->second.size();
+		}
+		feature_tt.reserve(feature_tt.size() + successors);
+	}
+
+	// Positions are extracted a chunk at a time. Boards and features are computed in parallel, while the
+	// transposition table is only read and written between the parallel stages, so the matrix is the
+	// same whatever the number of threads
+	const int chunk_size = 256;
+	for (int begin = matrix_scanned; begin < n_eval; begin += chunk_size) {
+		int end = min(begin + chunk_size, n_eval);
+
+		// Only look at drop moves in drop test mode
+		vector<int> indices;
+		for (int i = begin; i < end; i++) {
+			if (mode == train_drops and !movePlaying(sample[i].pmove)) continue;
+			indices.push_back(i);
+		}
+		int n_chunk = indices.size();
+
+		// Legal moves of each position and the hash of the board each one leads to. Shogi::operator= only
+		// copies into a board that has been initialized
+		Shogi initial;
+		initial.Init();
+		vector<Shogi> boards(n_chunk, initial);
+		vector<vector<int>> moves(n_chunk);
+		vector<vector<uint64_t>> keys(n_chunk);
+
+		#pragma omp parallel
+		{
+			FeatureProfile local_profile;
+			if (profiling) {
+				local_profile.reset(profile_labels.size());
+			}
+			ProfileTimer timer(profiling ? &local_profile : nullptr);
+
+			#pragma omp for schedule(dynamic)
+			for (int k = 0; k < n_chunk; k++) {
+				const SamplePosition& position = sample[indices[k]];
+				boards[k] = load_game(position.digest);
+				timer.lap(profile_load_board);
+
+				moves[k] = legal_moves(position.board, boards[k]);
+				for (int move : moves[k]) {
+					Shogi result = boards[k];
+					result.MakeMove(move);
+					keys[k].push_back(FeatureCache::hash(result.SaveGame()));
+					timer.lap(profile_make_move);
+				}
+			}
+
+			if (profiling) {
+				#pragma omp critical(profile_merge)
+				profile.merge(local_profile);
+			}
+		}
+
+		// Successors not in the table yet, each extracted once even if several positions lead to it
+		ProfileTimer lookup_timer(profiling ? &profile : nullptr);
+		vector<vector<vector<int>>> rows(n_chunk);
+		vector<vector<int>> row_source(n_chunk);
+		vector<pair<int, int>> pending;
+		unordered_map<uint64_t, int> pending_index;
+		for (int k = 0; k < n_chunk; k++) {
+			rows[k].resize(keys[k].size());
+			row_source[k].assign(keys[k].size(), -1);
+			for (size_t j = 0; j < keys[k].size(); j++) {
+				const int* cached = feature_tt.find(keys[k][j]);
+				if (cached) {
+					rows[k][j].assign(cached, cached + FeatureCache::n_features);
+					continue;
+				}
+
+				auto itr = pending_index.find(keys[k][j]);
+				if (itr == pending_index.end()) {
+					itr = pending_index.insert({keys[k][j], pending.size()}).first;
+					pending.push_back({k, j});
+				}
+				row_source[k][j] = itr->second;
+			}
+		}
+		lookup_timer.lap(profile_cache_lookup);
+
+		vector<vector<int>> extracted(pending.size());
+
+		#pragma omp parallel
+		{
+			FeatureProfile local_profile;
+			if (profiling) {
+				local_profile.reset(profile_labels.size());
+			}
+			ProfileTimer timer(profiling ? &local_profile : nullptr);
+
+			// Working state for feature extraction, one per thread
+			FeatureScratch scratch;
+			scratch.profile = profiling ? &local_profile : nullptr;
+
+			#pragma omp for schedule(dynamic, 16)
+			for (int e = 0; e < (int)pending.size(); e++) {
+				int k = pending[e].first;
+				Shogi result = boards[k];
+				result.MakeMove(moves[k][pending[e].second]);
+				timer.lap(profile_make_move);
 
+				// Update attack map needed in heuristic calculations
+				result.FetchMove(1);
+				timer.lap(profile_attack_map);
 
-		// Update highest score
-		if (score > best_score) {
-				best_score = score;
-				best_move = move;
+				// Perspective for the heuristic evaluation is the current player for the input board
+				extracted[e] = heuristic.feature_vec_raw(result, boards[k].round % 2, scratch);
+
+				// Feature functions are timed individually through the scratch buffer
+				timer.restart();
+			}
+
+			if (profiling) {
+				#pragma omp critical(profile_merge)
+				profile.merge(local_profile);
+			}
 		}
 
-		pos++;
+		// Positions are added in sample order, first occurrences of each successor go in the table
+		for (size_t e = 0; e < pending.size(); e++) {
+			feature_tt.insert(keys[pending[e].first][pending[e].second], extracted[e]);
+		}
+		for (int k = 0; k < n_chunk; k++) {
+			for (size_t j = 0; j < keys[k].size(); j++) {
+				if (row_source[k][j] != -1) rows[k][j] = extracted[row_source[k][j]];
+			}
+			matrix.add_position(indices[k], sample[indices[k]].pmove, moves[k], rows[k]);
+		}
+		lookup_timer.lap(profile_cache_lookup);
 	}
 
-	return best_move;
+	matrix_scanned = n_eval;
+
+	if (!matrix_cache_dir.empty()) {
+		string path = matrix_file();
+		if (!matrix.save(path, data_key(), matrix_scanned)) {
+			cout << "Could not save feature matrix to " << path << endl;
+		}
+	}
+}
+
+void OrganismEvaluator::share(string path) {
+	build_matrix();
+	if (!matrix.save(path, data_key(), matrix_scanned)) {
+		throw runtime_error("Could not write feature matrix to " + path);
+	}
+
+	// Switch to the shared copy too, so this process does not keep a private one
+	int scanned = 0;
+	matrix.load(path, data_key(), scanned);
+}
+
+void OrganismEvaluator::attach(string path) {
+	uint64_t key = 0;
+	int scanned = 0;
+	if (!matrix.attach(path, key, scanned)) {
+		throw invalid_argument("Not a feature matrix: " + path);
+	}
+
+	// Per move stats need the sample boards, attached evaluators only count totals
+	attached = true;
+	tt_full = true;
+	memo_clear();
+	square_pieces.clear();
+	matrix_key = key;
+	matrix_scanned = scanned;
+	n_eval = scanned;
+}
+
+/* Number of positions in the feature matrix that belong to the first n_eval samples */
+int OrganismEvaluator::matrix_positions() {
+	// Positions are added in sample order so the first n_eval samples are a prefix of the matrix
+	int n_positions = 0;
+	while (n_positions < matrix.num_positions() and matrix.sample_index(n_positions) < n_eval) {
+		n_positions++;
+	}
+	return n_positions;
+}
+
+void OrganismEvaluator::set_batch(int size, unsigned seed) {
+	if (size < 0) {
+		throw invalid_argument("Batch size must be positive, or 0 to evaluate every position.");
+	}
+	batch_size = size;
+	batch_seed = seed;
+}
+
+void OrganismEvaluator::set_generation(int gen) {
+	generation = gen;
+}
+
+/* Matrix positions to evaluate, the first n_eval samples or a batch drawn from them */
+vector<int> OrganismEvaluator::eval_positions() {
+	int n_positions = matrix_positions();
+	vector<int> positions(n_positions);
+	for (int p = 0; p < n_positions; p++) {
+		positions[p] = p;
+	}
+	if (batch_size == 0 or batch_size >= n_positions) {
+		return positions;
+	}
+
+	// Partial Fisher-Yates shuffle. seed_seq and mt19937 are fully specified by the standard (unlike the
+	// distributions) so a seed and generation give the same batch on every platform
+	seed_seq seq = {batch_seed, (unsigned)generation};
+	mt19937 rng(seq);
+	for (int i = 0; i < batch_size; i++) {
+		int j = i + rng() % (n_positions - i);
+		swap(positions[i], positions[j]);
+	}
+	positions.resize(batch_size);
+
+	// Sorted so rows are still read in order
+	sort(positions.begin(), positions.end());
+	return positions;
+}
+
+vector<int> OrganismEvaluator::get_batch() {
+	build_matrix();
+
+	vector<int> indices;
+	for (int p : eval_positions()) {
+		indices.push_back(matrix.sample_index(p));
+	}
+	return indices;
+}
+
+/* Record the piece types of the boards of matrix positions not indexed yet */
+void OrganismEvaluator::index_pieces() {
+	if (attached) return;
+
+	int indexed = square_pieces.size() / 81;
+	int n_positions = matrix_positions();
+	if (n_positions <= indexed) return;
+
+	square_pieces.resize((size_t)n_positions * 81);
+
+	#pragma omp parallel for schedule(static)
+	for (int p = indexed; p < n_positions; p++) {
+		Shogi s = load_game(sample[matrix.sample_index(p)].digest);
+		for (int square = 0; square < 81; square++) {
+			int goma = s.board[square];
+			square_pieces[(size_t)p * 81 + square] = goma == -1 ? -1 : gomakindEID(s.gomaKind[goma]);
+		}
+	}
+}
+
+/* Score every successor in the feature matrix and compare the best with the grandmaster move */
+int OrganismEvaluator::evaluate_matrix(vector<int> weights, int& pos) {
+	vector<int> positions = eval_positions();
+	bool detailed = log and !attached;
+	if (detailed) {
+		index_pieces();
+	}
+
+	// Scoring runs on all threads at once, so it is timed as a whole
+	ProfileTimer timer(profiling ? &profile : nullptr);
+	vector<int> best;
+	matrix.select_rows(heuristic.effective_weights(weights), positions, best);
+	timer.lap(profile_scoring);
+
+	int correct = 0;
+	int positions_evaluated = 0;
+	int n_positions = positions.size();
+
+	#pragma omp parallel reduction(+:correct,positions_evaluated)
+	{
+		EvaluationStats counts;
+
+		#pragma omp for schedule(static)
+		for (int i = 0; i < n_positions; i++) {
+			int p = positions[i];
+			int move = best[i] == -1 ? 0 : matrix.move(best[i]);
+			int grandmaster_move = matrix.gm_move(p);
+
+			if (detailed) {
+				log_stats(p, move, grandmaster_move, weights, counts);
+			}
+
+			if (move == grandmaster_move) {
+				correct++;
+			}
+
+			positions_evaluated += matrix.segment_end(p) - matrix.segment_begin(p);
+		}
+
+		#pragma omp critical
+		stats += counts;
+	}
+
+	pos += positions_evaluated;
+	return correct;
+}
+
+const array<const char*, N_EVALUATION_STATS> EvaluationStats::labels = {{
+	"eval_time_ms",
+	"total_positions_evaluated",
+	"total_correct",
+	"total_positions",
+	"gm_drop_total",
+	"gm_up_total",
+	"h_drop_total",
+	"h_missed_drops",
+	"h_missed_ups",
+	"h_up_total",
+	"h_up_same_square_same_piece",
+	"h_up_same_square_diff_piece",
+	"h_up_diff_square_diff_piece",
+	"h_up_diff_square_same_piece",
+	"h_drop_same_square_same_piece",
+	"h_drop_same_square_diff_piece",
+	"h_drop_diff_square_diff_piece",
+	"h_drop_diff_square_same_piece",
+	"h_drop_when_gm_normal",
+	"h_up_when_gm_normal",
+	"h_move_same_square_same_piece",
+	"h_move_same_square_diff_piece",
+	"h_move_diff_square_diff_piece",
+	"h_move_diff_square_same_piece",
+	"h_drop_same_square_as_gm_normal",
+	"h_up_when_gm_normal_same_square_same_piece",
+	"h_up_when_gm_normal_same_square_diff_piece",
+	"h_up_when_gm_normal_diff_square_same_piece",
+	"h_up_when_gm_normal_diff_square_diff_piece",
+}};
+
+EvaluationStats& EvaluationStats::operator+=(const EvaluationStats& other) {
+	for (int i = 0; i < N_EVALUATION_STATS; i++) {
+		counts[i] += other.counts[i];
+	}
+	return *this;
+}
+
+map<string, int> EvaluationStats::to_map() const {
+	map<string, int> result;
+	for (int i = 0; i < N_EVALUATION_STATS; i++) {
+		result[labels[i]] = counts[i];
+	}
+	return result;
+}
+
+const array<const char*, N_RANK_CATEGORIES> RankStats::category_labels = {{
+	"all",
+	"drops",
+	"promotions",
+	"normal",
+}};
+
+const array<const char*, N_RANK_METRICS> RankStats::labels = {{
+	"positions",
+	"top1",
+	"top3",
+	"top5",
+	"mrr",
+	"mean_rank",
+}};
+
+void RankStats::add(RankCategory category, int rank, int n_successors) {
+	if (rank == 0) rank = n_successors + 1;
+
+	for (RankCategory c : {RANK_ALL, category}) {
+		(*this)(c, RANK_POSITIONS) += 1;
+		(*this)(c, RANK_TOP1) += rank <= 1;
+		(*this)(c, RANK_TOP3) += rank <= 3;
+		(*this)(c, RANK_TOP5) += rank <= 5;
+		(*this)(c, RANK_MRR) += 1.0 / rank;
+		(*this)(c, RANK_MEAN) += rank;
+	}
+}
+
+void RankStats::finish() {
+	for (int c = 0; c < N_RANK_CATEGORIES; c++) {
+		double n = values[c * N_RANK_METRICS + RANK_POSITIONS];
+		if (n == 0) continue;
+		for (int m = RANK_TOP1; m < N_RANK_METRICS; m++) {
+			values[c * N_RANK_METRICS + m] /= n;
+		}
+	}
 }
 
 void OrganismEvaluator::init_stats() {
-	stats["eval_time_ms"] = 0;
-	stats["total_positions_evaluated"] = 0;
-	stats["total_correct"] = 0;
-	stats["total_positions"] = 0;
-
-	stats["gm_drop_total"] = 0;
-	stats["gm_up_total"] = 0;
-	stats["h_drop_total"] = 0;
-	stats["h_missed_drops"] = 0;
-	stats["h_missed_ups"] = 0;
-	stats["h_up_total"] = 0;
-
-	// Stats for upgrades
-	stats["h_up_same_square_same_piece"] = 0;
-	stats["h_up_same_square_diff_piece"] = 0;
-	stats["h_up_diff_square_diff_piece"] = 0;
-	stats["h_up_diff_square_same_piece"] = 0;
-
-	// Stats for drops
-	stats["h_drop_same_square_same_piece"] = 0;
-	stats["h_drop_same_square_diff_piece"] = 0;
-	stats["h_drop_diff_square_diff_piece"] = 0;
-	stats["h_drop_diff_square_same_piece"] = 0;
-	
-	// Stats for regular moves
-	stats["h_drop_when_gm_normal"] = 0;
-	stats["h_up_when_gm_normal"] = 0;
-	stats["h_move_same_square_same_piece"] = 0;
-	stats["h_move_same_square_diff_piece"] = 0;
-	stats["h_move_diff_square_diff_piece"] = 0;
-	stats["h_move_diff_square_same_piece"] = 0;
-	stats["h_drop_same_square_as_gm_normal"] = 0;
-	stats["h_up_when_gm_normal_same_square_same_piece"] = 0;
-	stats["h_up_when_gm_normal_same_square_diff_piece"] = 0;
-	stats["h_up_when_gm_normal_diff_square_same_piece"] = 0;
-	stats["h_up_when_gm_normal_diff_square_diff_piece"] = 0;
-}
-
-void OrganismEvaluator::log_stats(string board, int move, int grandmaster_move, vector<int> weights) {
-	
-	// Initialize board in order to check for piece correctness etc
-	Shogi s = load_game(board);
-	
-	// Resulting board of grand master move move
-	Shogi gm = s;
-	gm.MakeMove(grandmaster_move);
+	stats = EvaluationStats();
+}
 
-	// Resulting board of heuristic move
-	Shogi h = s;
-	h.MakeMove(move);
+void OrganismEvaluator::log_stats(int position, int move, int grandmaster_move, const vector<int>& weights,
+		EvaluationStats& counts) {
 
 	int h_new_pos = moveNewpos(move);
 	int gm_new_pos = moveNewpos(grandmaster_move);
 	int h_pre_pos = movePrepos(move);
 	int gm_pre_pos = movePrepos(grandmaster_move);
-	int h_goma_kind = h.gomaKind[h.board[h_new_pos]];
-	int gm_goma_kind = gm.gomaKind[gm.board[gm_new_pos]];
 
-	// Type of piece that was moved, ie. pawn, promoted bishop, etc
-	int h_piece_type = gomakindEID(h_goma_kind);
-	int gm_piece_type = gomakindEID(gm_goma_kind);
+	// Type of piece that was moved, ie. pawn, promoted bishop, etc. A drop places the unpromoted piece
+	// given by its origin, any other move keeps the piece on the origin square, promoting it if asked
+	const int8_t* pieces = &square_pieces[(size_t)position * 81];
+	auto moved_piece = [pieces](int m) -> int {
+		if (PLAYING == movePlaying(m)) return movePrepos(m);
+		return pieces[movePrepos(m)] + moveUpgrade(m) * 8;
+	};
+	int h_piece_type = moved_piece(move);
+	int gm_piece_type = moved_piece(grandmaster_move);
 
 
 	if (log) {
 			/* /1* // Print out the board and the drop move if in debug mode *1/ */
 			if (DEBUG and mode == train_drops) {
-				vector<int> fv = heuristic.feature_vec_raw(gm);
+				Shogi s = load_game(sample[matrix.sample_index(position)].digest);
+				Shogi gm = s;
+				gm.MakeMove(grandmaster_move);
+				Shogi h = s;
+				h.MakeMove(move);
+  			int player = (s.round % 2);
+				FeatureScratch scratch;
+
+				vector<int> fv = heuristic.feature_vec_raw(gm, player, scratch);
 				int gm_score = heuristic.evaluate_feature_vec(fv, weights);
 
-				vector<int> fvH = heuristic.feature_vec_raw(h);
+				vector<int> fvH = heuristic.feature_vec_raw(h, player, scratch);
 				int h_score = heuristic.evaluate_feature_vec(fvH, weights);
 
-  			int player = (s.round % 2);
 				string turn = player == SENTE ? "Sente" : "Gote";
 
 				cout << "Grandmaster Drop Move for " << turn << endl;
@@ -226,224 +817,430 @@ void OrganismEvaluator::log_stats(string board, int move, int grandmaster_move,
 
 			// See if grandmaster played a drop move
 			if (PLAYING == movePlaying(grandmaster_move)) {
-				stats["gm_drop_total"] += 1;
+				counts[GM_DROP_TOTAL] += 1;
 
 				if (PLAYING == movePlaying(move)) {
-					stats["h_drop_total"] += 1;
+					counts[H_DROP_TOTAL] += 1;
 
 					// Heuristic guessed same square and same piece
 					if (move == grandmaster_move) {
-						stats["h_drop_same_square_same_piece"] += 1;
+						counts[H_DROP_SAME_SQUARE_SAME_PIECE] += 1;
 					} 
 
 					// Heuristic also played a drop move on the same square, but different piece
 					else if (h_new_pos == gm_new_pos) {
-						stats["h_drop_same_square_diff_piece"] += 1;
+						counts[H_DROP_SAME_SQUARE_DIFF_PIECE] += 1;
 					}
 
 					// Heuristic played a drop of same piece on different square
 					else if (h_piece_type == gm_piece_type) {
-						stats["h_drop_diff_square_same_piece"] += 1;
+						counts[H_DROP_DIFF_SQUARE_SAME_PIECE] += 1;
 					}
 
 					// Heuristic played a drop of different piece on different square
 					else {
-						stats["h_drop_diff_square_diff_piece"] += 1;
+						counts[H_DROP_DIFF_SQUARE_DIFF_PIECE] += 1;
 					}
 				} 
 
 				// Otherwise heuristic didnt drop when it should have
 				else {
-					stats["h_missed_drops"] += 1;
+					counts[H_MISSED_DROPS] += 1;
 				}
 			}
 
 			// See if grandmaster played a upgrade move
 			else if (UPGRADED == moveUpgrade(grandmaster_move)) {
-				stats["gm_up_total"] += 1;
+				counts[GM_UP_TOTAL] += 1;
 
 				if (UPGRADED == moveUpgrade(move)) {
-					stats["h_up_total"] += 1;
+					counts[H_UP_TOTAL] += 1;
 
 					if (move == grandmaster_move) {
-						stats["h_up_same_square_same_piece"] += 1;
+						counts[H_UP_SAME_SQUARE_SAME_PIECE] += 1;
 					}
 
 					// Heuristic moved and upgraded the same piece, but ended on diff square
 					else if (h_pre_pos == gm_pre_pos) {
-						stats["h_up_diff_square_same_piece"] += 1;
+						counts[H_UP_DIFF_SQUARE_SAME_PIECE] += 1;
 					}
 					
 					else if (h_new_pos == gm_new_pos) {
-						stats["h_up_same_square_diff_piece"] += 1;
+						counts[H_UP_SAME_SQUARE_DIFF_PIECE] += 1;
 					}
 
 					else {
-						stats["h_up_diff_square_diff_piece"] += 1;
+						counts[H_UP_DIFF_SQUARE_DIFF_PIECE] += 1;
 					}
 				}
 
 				// Otherwise heuristic missed an upgrade when it should have
 				else {
-					stats["h_missed_ups"] += 1;
+					counts[H_MISSED_UPS] += 1;
 				}
 			} 
 
 			// Otherwise it is just a regular move for gm
 			else {
 				if (move == grandmaster_move) {
-					stats["h_move_same_square_same_piece"] += 1;
+					counts[H_MOVE_SAME_SQUARE_SAME_PIECE] += 1;
 				}
 				// Heuristic dropped when grandmaster played regular move
 				else if (PLAYING == movePlaying(move)) {
-					stats["h_drop_when_gm_normal"] += 1;
+					counts[H_DROP_WHEN_GM_NORMAL] += 1;
 
 					if (h_new_pos == gm_new_pos) {
-						stats["h_drop_same_square_as_gm_normal"] += 1;
+						counts[H_DROP_SAME_SQUARE_AS_GM_NORMAL] += 1;
 					}
 				}
 				// Heuristic upgraded when grandmaster played regular move
 				else if (UPGRADED == moveUpgrade(move)) {
-					stats["h_up_when_gm_normal"] += 1;
+					counts[H_UP_WHEN_GM_NORMAL] += 1;
 
 					// Heuristic made exact same move, but just chose to upgrade
 					if (h_pre_pos == gm_pre_pos and h_new_pos == gm_new_pos) {
-						stats["h_up_when_gm_normal_same_square_same_piece"] += 1;
+						counts[H_UP_WHEN_GM_NORMAL_SAME_SQUARE_SAME_PIECE] += 1;
 					} else if (h_pre_pos == gm_pre_pos) {
-						stats["h_up_when_gm_normal_diff_square_same_piece"] += 1;
+						counts[H_UP_WHEN_GM_NORMAL_DIFF_SQUARE_SAME_PIECE] += 1;
 					} else if (h_new_pos == gm_new_pos) {
-						stats["h_up_when_gm_normal_same_square_diff_piece"] += 1;
+						counts[H_UP_WHEN_GM_NORMAL_SAME_SQUARE_DIFF_PIECE] += 1;
 					} else {
-						stats["h_up_when_gm_normal_diff_square_diff_piece"] += 1;
+						counts[H_UP_WHEN_GM_NORMAL_DIFF_SQUARE_DIFF_PIECE] += 1;
 					}
 				}
 				else if (h_pre_pos == gm_pre_pos) {
-					stats["h_move_diff_square_same_piece"] += 1;
+					counts[H_MOVE_DIFF_SQUARE_SAME_PIECE] += 1;
 				}
 				else if (h_new_pos == gm_new_pos) {
-					stats["h_move_same_square_diff_piece"] += 1;
+					counts[H_MOVE_SAME_SQUARE_DIFF_PIECE] += 1;
 				}
 				else {
-					stats["h_move_diff_square_diff_piece"] += 1;
+					counts[H_MOVE_DIFF_SQUARE_DIFF_PIECE] += 1;
 				}
 			}
 	
 	// Other stats, just keep track of total n positions 
-	stats["total_positions"] += 1;
+	counts[TOTAL_POSITIONS] += 1;
 	}
 }
 
-int OrganismEvaluator::evaluate_synchronous(vector<int> weights, int& pos) {
+int OrganismEvaluator::evaluate_organism(vector<int> weights) {
+
+	// Error check incase something invalid thrown from python (-1 bc now weight for pawn)
+	if ((int)weights.size() != heuristic.num_features()) {
+		string error = "Expected " + to_string(heuristic.num_features()) + " weights but " \
+									 "passed " + to_string(weights.size());
+
+		throw invalid_argument(error);
+	}
+
+	// Organisms already scored on the same positions are not evaluated again, unless only their totals
+	// were remembered and the per move stats are logged
+	uint64_t key = memo_key(weights);
+	const MemoEntry* entry = memo_find(weights, key, log);
+	if (entry != nullptr) {
+		stats = entry->stats;
+		return entry->fitness;
+	}
 
 	// Loop through all of the training games
 	int correct = 0;
 	int positions = 0;
+	init_stats();
 
-	// Compiler directive to make segment parallel, specifies correct/positions as shared
-	for (int i = 0; i < n_eval; i++) {
-		auto game = sample[i];
-		string board = game.first;
-    int grandmaster_move = game.second;
+	// Uncomment for timing during featuresTests
+	auto start = high_resolution_clock::now();
 
-		// Only look at drop moves in drop test mode
-		if (mode == train_drops and !movePlaying(grandmaster_move)) continue;
+	// Features never depend on the weights, so every successor is extracted once into the matrix
+	build_matrix();
+	correct = evaluate_matrix(weights, positions);
 
-		// Select a move using the given weights and set of shogi features
-		int move = select_move(board, weights, positions);
+	if (log) {
+		// Add some stats about overall organism evaluation
+		auto stop = high_resolution_clock::now();
+		auto duration = duration_cast<milliseconds>(stop - start);
+		stats[EVAL_TIME_MS] = int(duration.count());
+		stats[TOTAL_POSITIONS_EVALUATED] = positions;
+		stats[TOTAL_CORRECT] = correct;
+	}
 
-		// Log statistics about the selection
-		log_stats(board, move, grandmaster_move, weights);
+	// After first full run mark the transposition table as full to be used later
+	if (!tt_full) {
+		tt_full = true;
+	}
 
-		// Compare selection with the choice of the grandmaster
-		if (move == grandmaster_move) {
-			correct++;
+	// Overall fitness is the square of total number of correct moves
+	memo_insert(weights, key, correct * correct, true);
+	return (correct * correct);
+}
+
+pair<int, bool> OrganismEvaluator::evaluate_racing(vector<int> weights, int threshold) {
+	if ((int)weights.size() != heuristic.num_features()) {
+		string error = "Expected " + to_string(heuristic.num_features()) + " weights but " \
+									 "passed " + to_string(weights.size());
+
+		throw invalid_argument(error);
+	}
+
+	// A remembered fitness is always complete, and every entry holds the totals a race reports
+	uint64_t key = memo_key(weights);
+	const MemoEntry* entry = memo_find(weights, key);
+	if (entry != nullptr) {
+		stats = entry->stats;
+		return {entry->fitness, true};
+	}
+
+	init_stats();
+	auto start = high_resolution_clock::now();
+
+	build_matrix();
+	vector<int> positions = eval_positions();
+	vector<int> effective = heuristic.effective_weights(weights);
+
+	int correct = 0;
+	int evaluated = 0;
+	int n_positions = positions.size();
+	int done = 0;
+	vector<int> chunk, best;
+	ProfileTimer timer(profiling ? &profile : nullptr);
+	while (done < n_positions) {
+		// Even if every remaining position were correct the organism could not beat the threshold
+		long long ceiling = correct + (n_positions - done);
+		if (ceiling * ceiling <= threshold) {
+			break;
 		}
 
-		if (DEBUG) {
-			cout << "Grandmaster move:" << endl;
-			cout << "     ";
-			printMove(grandmaster_move);
-			cout << "Heuristic chose:  " << endl;
-			cout << "     ";
-			printMove(move);
+		int end = min(done + racing_chunk, n_positions);
+		chunk.assign(positions.begin() + done, positions.begin() + end);
+		timer.restart();
+		matrix.select_rows(effective, chunk, best);
+		timer.lap(profile_scoring);
+		for (size_t i = 0; i < chunk.size(); i++) {
+			int move = best[i] == -1 ? 0 : matrix.move(best[i]);
+			if (move == matrix.gm_move(chunk[i])) {
+				correct++;
+			}
+			evaluated += matrix.segment_end(chunk[i]) - matrix.segment_begin(chunk[i]);
 		}
+		done = end;
 	}
 
-	pos += positions;
-	return correct;
+	if (log) {
+		auto stop = high_resolution_clock::now();
+		stats[EVAL_TIME_MS] = int(duration_cast<milliseconds>(stop - start).count());
+		stats[TOTAL_POSITIONS_EVALUATED] = evaluated;
+		stats[TOTAL_CORRECT] = correct;
+		stats[TOTAL_POSITIONS] = done;
+	}
+
+	tt_full = true;
+
+	// Only a complete race is the organism's fitness, an early stop is just a bound
+	if (done == n_positions) {
+		memo_insert(weights, key, correct * correct, false);
+	}
+	return {correct * correct, done == n_positions};
 }
 
-int OrganismEvaluator::evaluate_parallel(vector<int> weights, int&pos) {
-	// Loop through all of the training games
-	int correct = 0;
-	int positions = 0;
+vector<int> OrganismEvaluator::evaluate_population(vector<vector<int>> population) {
+	for (auto& weights : population) {
+		if ((int)weights.size() != heuristic.num_features()) {
+			string error = "Expected " + to_string(heuristic.num_features()) + " weights but " \
+										 "passed " + to_string(weights.size());
 
-	// Compiler directive to make segment parallel, specifies correct/positions as shared
-	#pragma omp parallel for reduction(+:correct,positions)
-	for (int i = 0; i < n_eval; i++) {
-		auto game = sample[i];
-		string board = game.first;
-    int grandmaster_move = game.second;
+			throw invalid_argument(error);
+		}
+	}
 
-		// Only look at drop moves in drop test mode
-		if (mode == train_drops and !movePlaying(grandmaster_move)) continue;
+	init_stats();
+	auto start = high_resolution_clock::now();
 
-		// Select a move using the given weights and set of shogi features
-		int move = select_move(board, weights, positions);
+	build_matrix();
+	vector<int> positions = eval_positions();
+
+	int evaluated = 0;
+	for (int p : positions) {
+		evaluated += matrix.segment_end(p) - matrix.segment_begin(p);
+	}
 
-		// Compare selection with the choice of the grandmaster
-		if (move == grandmaster_move) {
-			correct++;
+	// Only organisms missing from the memo are scored, linked weights folded in once per organism
+	vector<int> fitness(population.size());
+	vector<uint64_t> keys(population.size());
+	vector<int> missing;
+	vector<vector<int>> effective;
+	for (size_t o = 0; o < population.size(); o++) {
+		keys[o] = memo_key(population[o]);
+		const MemoEntry* entry = memo_find(population[o], keys[o]);
+		if (entry != nullptr) {
+			fitness[o] = entry->fitness;
+		} else {
+			missing.push_back(o);
+			effective.push_back(heuristic.effective_weights(population[o]));
 		}
 	}
 
-	pos += positions;
-	return correct;
+	vector<vector<int>> best;
+	if (!missing.empty()) {
+		ProfileTimer timer(profiling ? &profile : nullptr);
+		matrix.select_rows(effective, positions, best);
+		timer.lap(profile_scoring);
+	}
+
+	// Same fitness as evaluate_organism, the square of the number of correct moves
+	EvaluationStats totals = stats;
+	for (size_t m = 0; m < missing.size(); m++) {
+		int correct = 0;
+		for (size_t i = 0; i < positions.size(); i++) {
+			int move = best[m][i] == -1 ? 0 : matrix.move(best[m][i]);
+			if (move == matrix.gm_move(positions[i])) {
+				correct++;
+			}
+		}
+		int o = missing[m];
+		fitness[o] = correct * correct;
+
+		// Remembered with the totals a complete race would report
+		stats[TOTAL_POSITIONS_EVALUATED] = evaluated;
+		stats[TOTAL_CORRECT] = correct;
+		stats[TOTAL_POSITIONS] = positions.size();
+		memo_insert(population[o], keys[o], fitness[o], false);
+	}
+	stats = totals;
+
+	// Per move statistics are not kept for a population, only the totals of the whole call
+	if (log) {
+		auto stop = high_resolution_clock::now();
+		stats[EVAL_TIME_MS] = int(duration_cast<milliseconds>(stop - start).count());
+		stats[TOTAL_POSITIONS_EVALUATED] = evaluated;
+	}
+
+	tt_full = true;
+	return fitness;
 }
 
-int OrganismEvaluator::evaluate_organism(vector<int> weights) {
+RankStats OrganismEvaluator::rank_stats(const vector<int>& positions, const vector<int>& ranks) {
+	RankStats result;
+	for (size_t i = 0; i < positions.size(); i++) {
+		int p = positions[i];
+		int grandmaster_move = matrix.gm_move(p);
+
+		RankCategory category = RANK_NORMAL;
+		if (PLAYING == movePlaying(grandmaster_move)) {
+			category = RANK_DROPS;
+		} else if (UPGRADED == moveUpgrade(grandmaster_move)) {
+			category = RANK_PROMOTIONS;
+		}
+		result.add(category, ranks[i], matrix.segment_end(p) - matrix.segment_begin(p));
+	}
+	result.finish();
+	return result;
+}
 
-	// Error check incase something invalid thrown from python (-1 bc now weight for pawn)
-	if (weights.size() != heuristic.num_features()) {
-		string error = "Expected " + to_string(heuristic.num_features()) + " weights but " \
-									 "passed " + to_string(weights.size());
+RankStats OrganismEvaluator::evaluate_ranks(vector<int> weights) {
+	return evaluate_population_ranks({weights})[0];
+}
 
-		throw invalid_argument(error);
+vector<RankStats> OrganismEvaluator::evaluate_population_ranks(vector<vector<int>> population) {
+	for (auto& weights : population) {
+		if ((int)weights.size() != heuristic.num_features()) {
+			string error = "Expected " + to_string(heuristic.num_features()) + " weights but " \
+										 "passed " + to_string(weights.size());
+
+			throw invalid_argument(error);
+		}
 	}
 
-	// Loop through all of the training games
-	int correct = 0;
-	int positions = 0;
-	init_stats();
+	build_matrix();
+	vector<int> positions = eval_positions();
 
-	// Uncomment for timing during featuresTests
+	vector<RankStats> result;
+	ProfileTimer timer(profiling ? &profile : nullptr);
+	if (population.size() == 1) {
+		vector<int> best, ranks;
+		matrix.select_rows(heuristic.effective_weights(population[0]), positions, best, ranks);
+		timer.lap(profile_scoring);
+		result.push_back(rank_stats(positions, ranks));
+	} else {
+		vector<vector<int>> effective;
+		for (auto& weights : population) {
+			effective.push_back(heuristic.effective_weights(weights));
+		}
+
+		vector<vector<int>> best, ranks;
+		timer.restart();
+		matrix.select_rows(effective, positions, best, ranks);
+		timer.lap(profile_scoring);
+		for (auto& organism_ranks : ranks) {
+			result.push_back(rank_stats(positions, organism_ranks));
+		}
+	}
+
+	tt_full = true;
+	return result;
+}
+
+vector<string> OrganismEvaluator::get_rank_labels() {
+	vector<string> labels;
+	for (const char* category : RankStats::category_labels) {
+		for (const char* metric : RankStats::labels) {
+			labels.push_back(string(category) + "_" + metric);
+		}
+	}
+	return labels;
+}
+
+vector<int> OrganismEvaluator::evaluate_shard(vector<vector<int>> population, int shard, int n_shards) {
+	if (n_shards <= 0 or shard < 0 or shard >= n_shards) {
+		throw out_of_range("Shard " + to_string(shard) + " out of " + to_string(n_shards));
+	}
+
+	vector<vector<int>> effective;
+	for (auto& weights : population) {
+		if ((int)weights.size() != heuristic.num_features()) {
+			string error = "Expected " + to_string(heuristic.num_features()) + " weights but " \
+										 "passed " + to_string(weights.size());
+
+			throw invalid_argument(error);
+		}
+		effective.push_back(heuristic.effective_weights(weights));
+	}
+
+	init_stats();
 	auto start = high_resolution_clock::now();
 
-	if (!tt_full) {
-		correct = evaluate_synchronous(weights, positions);
-	} else {
-		correct = evaluate_parallel(weights, positions);
+	// Contiguous block of the positions an evaluation would score
+	build_matrix();
+	vector<int> positions = eval_positions();
+	int n_positions = positions.size();
+	positions = vector<int>(positions.begin() + (long long)n_positions * shard / n_shards,
+	                        positions.begin() + (long long)n_positions * (shard + 1) / n_shards);
+
+	ProfileTimer timer(profiling ? &profile : nullptr);
+	vector<vector<int>> best;
+	matrix.select_rows(effective, positions, best);
+	timer.lap(profile_scoring);
+
+	vector<int> correct(population.size(), 0);
+	for (size_t o = 0; o < population.size(); o++) {
+		for (size_t i = 0; i < positions.size(); i++) {
+			int move = best[o][i] == -1 ? 0 : matrix.move(best[o][i]);
+			if (move == matrix.gm_move(positions[i])) {
+				correct[o]++;
+			}
+		}
 	}
 
 	if (log) {
-		// Add some stats about overall organism evaluation
 		auto stop = high_resolution_clock::now();
-		auto duration = duration_cast<milliseconds>(stop - start);
-		stats["eval_time_ms"] = int(duration.count());
-		stats["total_positions_evaluated"] = positions;
-		stats["total_correct"] = correct;
-	}
-
-	// After first full run mark the transposition table as full to be used later
-	if (!tt_full) {
-		tt_full = true;
+		stats[EVAL_TIME_MS] = int(duration_cast<milliseconds>(stop - start).count());
+		for (int p : positions) {
+			stats[TOTAL_POSITIONS_EVALUATED] += matrix.segment_end(p) - matrix.segment_begin(p);
+		}
 	}
 
-	// Overall fitness is the square of total number of correct moves
-	return (correct * correct);
+	return correct;
 }
 
-
 int main() {
     // Used if making featuresTests
 
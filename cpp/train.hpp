@@ -1,7 +1,12 @@
 #include "features.hpp"
+#include "feature-matrix.hpp"
+#include "feature-cache.hpp"
+#include "positions.hpp"
 #include <map>
 #include <climits>
 #include <algorithm>
+#include <deque>
+#include <unordered_map>
 #include <omp.h>
 
 #define STR1(x)  #x
@@ -12,28 +17,203 @@ using namespace std::chrono;
 
 vector<pair<string, int>> loadGames(string in_file);
 
+// A dataset position. The hex board keys the legal moves cache, the digest is what the board is loaded from
+struct SamplePosition {
+	string board;
+	vector<unsigned char> digest;
+	int pmove;
+};
+
+// Counters reported by get_evaluation_stats, in the order of EvaluationStats::labels
+enum EvaluationStat {
+	EVAL_TIME_MS,
+	TOTAL_POSITIONS_EVALUATED,
+	TOTAL_CORRECT,
+	TOTAL_POSITIONS,
+	GM_DROP_TOTAL,
+	GM_UP_TOTAL,
+	H_DROP_TOTAL,
+	H_MISSED_DROPS,
+	H_MISSED_UPS,
+	H_UP_TOTAL,
+	H_UP_SAME_SQUARE_SAME_PIECE,
+	H_UP_SAME_SQUARE_DIFF_PIECE,
+	H_UP_DIFF_SQUARE_DIFF_PIECE,
+	H_UP_DIFF_SQUARE_SAME_PIECE,
+	H_DROP_SAME_SQUARE_SAME_PIECE,
+	H_DROP_SAME_SQUARE_DIFF_PIECE,
+	H_DROP_DIFF_SQUARE_DIFF_PIECE,
+	H_DROP_DIFF_SQUARE_SAME_PIECE,
+	H_DROP_WHEN_GM_NORMAL,
+	H_UP_WHEN_GM_NORMAL,
+	H_MOVE_SAME_SQUARE_SAME_PIECE,
+	H_MOVE_SAME_SQUARE_DIFF_PIECE,
+	H_MOVE_DIFF_SQUARE_DIFF_PIECE,
+	H_MOVE_DIFF_SQUARE_SAME_PIECE,
+	H_DROP_SAME_SQUARE_AS_GM_NORMAL,
+	H_UP_WHEN_GM_NORMAL_SAME_SQUARE_SAME_PIECE,
+	H_UP_WHEN_GM_NORMAL_SAME_SQUARE_DIFF_PIECE,
+	H_UP_WHEN_GM_NORMAL_DIFF_SQUARE_SAME_PIECE,
+	H_UP_WHEN_GM_NORMAL_DIFF_SQUARE_DIFF_PIECE,
+	N_EVALUATION_STATS
+};
+
+// Fixed set of evaluation counters. Parallel evaluations fill one per thread and sum them at the end,
+// names are only attached when the stats are read
+struct EvaluationStats {
+	array<int, N_EVALUATION_STATS> counts;
+	static const array<const char*, N_EVALUATION_STATS> labels;
+
+	EvaluationStats() { counts.fill(0); }
+	int& operator[](EvaluationStat stat) { return counts[stat]; }
+	EvaluationStats& operator+=(const EvaluationStats& other);
+	map<string, int> to_map() const;
+};
+
+// Grandmaster moves rank metrics are broken down by: every position, then drops, promotions and other moves
+enum RankCategory {
+	RANK_ALL,
+	RANK_DROPS,
+	RANK_PROMOTIONS,
+	RANK_NORMAL,
+	N_RANK_CATEGORIES
+};
+
+// Metrics of each category: positions, fraction where the grandmaster move ranks first, in the top 3 and
+// in the top 5 of the successors, mean reciprocal rank and mean rank. A grandmaster move that is not among
+// the successors ranks after all of them
+enum RankMetric {
+	RANK_POSITIONS,
+	RANK_TOP1,
+	RANK_TOP3,
+	RANK_TOP5,
+	RANK_MRR,
+	RANK_MEAN,
+	N_RANK_METRICS
+};
+
+// Fixed array of rank metrics, category after category. Filled with sums while scoring, finish() turns
+// them into fractions and means
+struct RankStats {
+	array<double, N_RANK_CATEGORIES * N_RANK_METRICS> values;
+	static const array<const char*, N_RANK_CATEGORIES> category_labels;
+	static const array<const char*, N_RANK_METRICS> labels;
+
+	RankStats() { values.fill(0); }
+	double& operator()(RankCategory category, RankMetric metric) { return values[category * N_RANK_METRICS + metric]; }
+	void add(RankCategory category, int rank, int n_successors);
+	void finish();
+};
+
 class OrganismEvaluator {
 	public:
+		// Default dataset and legal moves cache paths are the ones given to make at compile time
 		OrganismEvaluator();
 
-		void evaluate(vector<int> weights, int& correct, int& positions);
-		int evaluate_synchronous(vector<int> weights, int&pos);
-		int evaluate_parallel(vector<int> weights, int&pos);
-		int select_move(string board, vector<int> weights, int& pos);
+		// Datasets and legal moves cache are only read the first time they are needed
+		OrganismEvaluator(string train_file, string test_file, string moves_file);
+
 		bool feature_cache_loaded() { return tt_full; };
 		void update_tt_status(bool status) { tt_full = status; };
 		void set_num_eval(int num_eval);
 		int evaluate_organism(vector<int> weights);
-		map<string, int> get_evaluation_stats() { return stats; };
+
+		// Racing evaluation, positions are scored in chunks and scoring stops as soon as the fitness can no
+		// longer exceed threshold (e.g. the k-th best fitness so far). Returns the fitness, which is only a
+		// lower bound when the second value (complete) is false
+		pair<int, bool> evaluate_racing(vector<int> weights, int threshold);
+
+		// Fitness of every organism in a generation from a single pass over the successor features
+		vector<int> evaluate_population(vector<vector<int>> population);
+		map<string, int> get_evaluation_stats() { return stats.to_map(); };
+
+		// Rank of the grandmaster move among the successors of every evaluated position, computed in the
+		// same pass that selects the best successor. Indexed by RankCategory * N_RANK_METRICS + RankMetric
+		RankStats evaluate_ranks(vector<int> weights);
+		vector<RankStats> evaluate_population_ranks(vector<vector<int>> population);
+
+		// Names of the rank metrics, "<category>_<metric>" in the order of RankStats::values
+		vector<string> get_rank_labels();
+
+		// Same counters without building a map, indexed by EvaluationStat in the order of the labels
+		const EvaluationStats& get_evaluation_counts() { return stats; };
+		vector<string> get_evaluation_stat_labels() {
+			return vector<string>(EvaluationStats::labels.begin(), EvaluationStats::labels.end());
+		};
 		void set_mode(string mode_string);
 		string get_mode() { return mode; };
-		int get_num_eval() { return n_eval; }
+		int get_num_eval() { if (!attached) load_sample(); return n_eval; }
 		vector<string> get_feature_labels() { return heuristic.features_vec_labels(); }
 		int get_num_features() { return heuristic.num_features(); }
 		int get_num_major_features() { return heuristic.num_major_features(); };
 
+		// Mini-batch mode, each evaluation scores a seeded random subset of batch_size positions out of the
+		// first n_eval instead of all of them, 0 to evaluate everything. The subset only changes with the
+		// generation, so every organism of a generation is scored on the same positions
+		void set_batch(int batch_size, unsigned seed);
+		int get_batch_size() { return batch_size; };
+		unsigned get_batch_seed() { return batch_seed; };
+		void set_generation(int generation);
+		int get_generation() { return generation; };
+
+		// Sample indices of the positions evaluated in the current generation
+		vector<int> get_batch();
+
+		// Save the successor feature matrix of the first n_eval positions to path (e.g. under /dev/shm) and
+		// map it back, so worker processes can attach to the same pages instead of loading the datasets,
+		// the legal moves cache and extracting features themselves
+		void share(string path);
+
+		// Score the positions of a matrix shared with share(). Nothing else is ever loaded, so the mode
+		// and the number of positions are those of the sharing evaluator (n_eval can only be lowered)
+		void attach(string path);
+		bool is_attached() { return attached; };
+
+		// Key of the dataset, mode and feature set the feature matrix is built from (and saved under)
+		uint64_t get_data_key() { return data_key(); }
+
+		// Number of correct moves of each organism on shard out of n_shards contiguous blocks of the
+		// positions an evaluation scores. Fitness is the square of the sum over all shards
+		vector<int> evaluate_shard(vector<vector<int>> population, int shard, int n_shards);
+
+		// Successor features of the first n_eval positions (positions [0, n) of the matrix), built if needed.
+		// For tuners working on the features directly
+		const FeatureMatrix& get_feature_matrix(int& n) { build_matrix(); n = matrix_positions(); return matrix; }
+		int get_feature_link(int feature) { return heuristic.feature_link(feature); }
+		int get_pawn_index() { return heuristic.getPawnIndex(); }
+		int get_pawn_value() { return heuristic.getPawnValue(); }
+
+		// Sente and gote raw feature vectors for a board, extracted in a single pass
+		pair<vector<int>, vector<int>> get_position_features(string board);
+
+		// Directory successor feature matrices are saved to and mapped from, empty to disable.
+		// Defaults to the directory of the legal moves cache
+		void set_cache_dir(string dir) { matrix_cache_dir = dir; };
+		string get_cache_dir() { return matrix_cache_dir; };
+
+		// Generate legal moves with Shogi::FetchMove(3) instead of reading them from the legal moves cache,
+		// which is then never loaded. Ties between equally scored moves follow the order moves are listed in,
+		// so results can differ slightly from the cache
+		void set_native_moves(bool native);
+		bool get_native_moves() { return native_moves; };
+
+		// Compare generated legal moves with the cache for the first n_eval positions of the sample
+		map<string, int> verify_native_moves();
+
+		// Entries, capacity, hits, misses and probe collisions of the feature transposition table,
+		// and entries, hits and misses of the fitness memo (memo_*)
+		map<string, long long> get_cache_stats();
+
+		// Most organisms remembered by the fitness memo before the oldest are forgotten, 0 to disable it
+		void set_memo_capacity(int capacity);
+		int get_memo_capacity() { return memo_capacity; };
+
+		// Opt-in instrumentation of feature functions and the stages of building the feature matrix
+		void set_profiling(bool enabled);
+		map<string, pair<long long, long long>> get_profile();
+
 	private:
-		// Number of positions in the train or test data to evaluate
+		// Number of positions in the train or test data to evaluate, 0 for all of them
 		int n_eval;
 
 		// Whether to evaluate using train or test data
@@ -43,18 +223,75 @@ class OrganismEvaluator {
 		const string train_drops = "train_drops";
 		vector<string> modes = {test_mode, train_mode, train_drops};
 		bool log;
-		void log_stats(string board, int move, int grandmaster_move, vector<int> weights);
+		void log_stats(int position, int move, int grandmaster_move, const vector<int>& weights,
+				EvaluationStats& counts);
+
+		// Type (gomakindEID) of the piece on each square of every matrix position, -1 when empty. Read once
+		// from the sample boards, so the per move stats are counted on every evaluation without loading
+		// boards. Attached evaluators have no boards and only count totals
+		vector<int8_t> square_pieces;
+		void index_pieces();
 
+		EvaluationStats stats;
+		RankStats rank_stats(const vector<int>& positions, const vector<int>& ranks);
+
+		// Cumulative {nanoseconds, calls} for each entry of profile_labels when profiling
+		bool profiling = false;
+		FeatureProfile profile;
+		vector<string> profile_labels;
+		int profile_load_board, profile_make_move, profile_cache_lookup, profile_attack_map, profile_scoring;
+		void init_profile();
 
-		map<string, int> stats;
 		MovesCache cache;
 		ShogiFeatures heuristic;
 		Shogi load_game(string board);
+		Shogi load_game(const vector<unsigned char>& digest);
+
+		// Successor features of every sample position scanned so far (matrix_scanned), built on the
+		// first evaluation and reused for every organism after that
+		FeatureMatrix matrix;
+		int matrix_scanned = 0;
+		void build_matrix();
+
+		// On disk copy of the matrix, named by a hash of the sample, its legal moves and the feature set
+		string matrix_cache_dir;
+		uint64_t matrix_key = 0;
+		bool attached = false;
+		uint64_t data_key();
+		string matrix_file();
+		int matrix_positions();
+
+		// Matrix positions scored by an evaluation, the batch of the current generation in mini-batch mode
+		int batch_size = 0;
+		unsigned batch_seed = 0;
+		int generation = 0;
+		vector<int> eval_positions();
+
+		// Positions scored between threshold checks in evaluate_racing
+		const int racing_chunk = 256;
+		int evaluate_matrix(vector<int> weights, int& pos);
 		void init_stats();
 
-		// Add a transpossition table to store feature vector values
-		// NOTE : MAKE THIS AN UNORDERED MAP ASAP!
-		map<vector<unsigned char>, vector<int>> feature_tt;
+		// Fitness and stats of recently evaluated weights, keyed by a hash of the weights, n_eval and the
+		// batch. Cleared whenever the data being evaluated changes (mode, legal move source). Racing and
+		// population entries only hold the totals, full_stats marks entries that also hold the per move stats
+		struct MemoEntry {
+			vector<int> weights;
+			int fitness;
+			EvaluationStats stats;
+			bool full_stats;
+		};
+		unordered_map<uint64_t, MemoEntry> memo;
+		deque<uint64_t> memo_order;
+		int memo_capacity = 4096;
+		long long memo_hits = 0, memo_misses = 0;
+		uint64_t memo_key(const vector<int>& weights);
+		const MemoEntry* memo_find(const vector<int>& weights, uint64_t key, bool full_stats = false);
+		void memo_insert(const vector<int>& weights, uint64_t key, int fitness, bool full_stats);
+		void memo_clear();
+
+		// Transposition table of feature vectors keyed by a hash of the resulting position
+		FeatureCache feature_tt;
 		bool tt_full = false;
 
 		/**
@@ -62,8 +299,10 @@ class OrganismEvaluator {
 		 * Function to load json file of training data into program memory.
 		 * Json file is created by python script sample.py and saved in the format
 		 *          {board_state : grandmaster_move}
+		 * Binary position files made by convert-positions are read directly without parsing, their
+		 * digests are kept as is and only json boards are decoded from hex.
 		 */
-		vector<pair<string, int>> loadGames(string file_name) {
+		vector<SamplePosition> loadGames(string file_name) {
 			// Throw error if file doesnt exist
 			ifstream fin(file_name);
 			if (fin.fail()) {
@@ -71,23 +310,40 @@ class OrganismEvaluator {
 					exit(-1);
 			}
 
+			vector<SamplePosition> result;
+			if (is_position_file(file_name)) {
+				for (auto& record : load_positions(file_name)) {
+					vector<unsigned char> digest(record.digest, record.digest + position_digest_size);
+					result.push_back({digest_to_hex(record.digest, position_digest_size), digest, record.gm_move});
+				}
+				return result;
+			}
+
 			json j;
 			fin >> j;
-			vector<pair<string, int>> result;
 			for (auto &item : j) {
-				pair<string, int> game = {item["board"], item["pmove"]};
-				result.push_back(game);
+				string board = item["board"];
+				result.push_back({board, load_hex_vector(board), item["pmove"]});
 			}
 			return result;
 		};
 
-		// Load legal moves cache, train, and test data at compile time
-		const string lm_cache = STR(MOVES_FILE);
-		vector<pair<string, int>> sample;
-		const vector<pair<string, int>> train_data = loadGames(STR(TRAIN_FILE));
-		const vector<pair<string, int>> test_data = loadGames(STR(TEST_FILE));
-		int n_train = train_data.size();
-		int n_test = test_data.size();
+		// Legal moves cache, train, and test data paths. Each file is loaded lazily on first use
+		const string train_file;
+		const string test_file;
+		const string lm_cache;
+		vector<SamplePosition> train_data;
+		vector<SamplePosition> test_data;
+		bool moves_loaded = false;
+		void load_moves_cache();
+
+		bool native_moves = false;
+		vector<int> legal_moves(const string& board, Shogi& s);
+
+		// Positions of the dataset used by the current mode (test data in test mode, train data otherwise)
+		vector<SamplePosition> sample;
+		bool sample_loaded = false;
+		void load_sample();
 };
 
 /* -------------- Load train, test, moves cache into memory --------------- */
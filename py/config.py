@@ -25,6 +25,30 @@ VERBOSE = False  # Print out each organism's weights throughout evolution
 
 EVAL_MODE = "train"
 
+# "deap" runs the generations in python with DEAP, "native" with the GeneticAlgorithm of the C++ module
+GA_ENGINE = "deap"
+
+# Island model of the native engine: populations of POP_SIZE evolving side by side, exchanging their
+# N_MIGRANTS best organisms every MIGRATION_INTERVAL generations over a "ring" or "complete" topology
+N_ISLANDS = 1
+MIGRATION_INTERVAL = 5
+N_MIGRANTS = 1
+TOPOLOGY = "ring"
+
+# Binary checkpoint of the native engine, saved every CHECKPOINT_INTERVAL generations. A run finding the
+# file resumes from it. None disables checkpointing
+CHECKPOINT_FILE = None
+CHECKPOINT_INTERVAL = 10
+
+# Datasets and legal moves cache for the evaluator, None uses the paths the C++ module was built with
+TRAIN_FILE = None
+TEST_FILE = None
+MOVES_FILE = None
+
+# Positions each generation is scored on, drawn from the first N_TRAIN with BATCH_SEED. 0 scores all of them
+BATCH_SIZE = 0
+BATCH_SEED = 0
+
 # Save all of the parameters into a list for easy import/exporting
 params = {
     "eval_lang": "C++",
@@ -39,5 +63,17 @@ params = {
     "log_file": LOG_FILE,
     "verbose": VERBOSE,
     "eval_mode": EVAL_MODE,
+    "ga_engine": GA_ENGINE,
+    "n_islands": N_ISLANDS,
+    "migration_interval": MIGRATION_INTERVAL,
+    "n_migrants": N_MIGRANTS,
+    "topology": TOPOLOGY,
+    "checkpoint_file": CHECKPOINT_FILE,
+    "checkpoint_interval": CHECKPOINT_INTERVAL,
     "organism_file": ORGANISM_SAVE_FILE,
+    "train_file": TRAIN_FILE,
+    "test_file": TEST_FILE,
+    "moves_file": MOVES_FILE,
+    "batch_size": BATCH_SIZE,
+    "batch_seed": BATCH_SEED,
 }
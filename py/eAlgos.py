@@ -38,6 +38,15 @@ def set_gene_value(population, gene):
     for ind in population:
         ind[gene['start']:gene['stop']] = gene['value']
 
+def evaluate_invalid(toolbox, invalid_ind):
+    '''
+    Fitness of each individual, evaluated as one batch when the toolbox registers evaluate_population
+    and one at a time through toolbox.map otherwise.
+    '''
+    if hasattr(toolbox, 'evaluate_population'):
+        return toolbox.evaluate_population(invalid_ind)
+    return toolbox.map(toolbox.evaluate, invalid_ind)
+
 def eaSimple(population,
              toolbox,
              cxpb,
@@ -64,7 +73,7 @@ def eaSimple(population,
 
     # Evaluate the individuals with an invalid fitness
     invalid_ind = [ind for ind in population if not ind.fitness.valid]
-    fitnesses = toolbox.map(toolbox.evaluate, invalid_ind)
+    fitnesses = evaluate_invalid(toolbox, invalid_ind)
     for ind, fit in zip(invalid_ind, fitnesses):
         ind.fitness.values = fit
 
@@ -97,17 +106,24 @@ def eaSimple(population,
         # Select the next generation individuals
         offspring = toolbox.select(population, len(population) - 1)
 
-        # Vary the pool of individuals
+        # Vary the pool of individuals, add back elitist
         offspring = varAnd(offspring, toolbox, cxpb, mutpb)
+        offspring.append(elitist)
+
+        # When each generation is scored on its own mini-batch of positions, fitness carried over
+        # from the last generation is not comparable, so every individual is scored again
+        if hasattr(toolbox, 'new_generation'):
+            toolbox.new_generation(gen)
+            for ind in offspring:
+                del ind.fitness.values
 
         # Evaluate the individuals with an invalid fitness
         invalid_ind = [ind for ind in offspring if not ind.fitness.valid]
-        fitnesses = toolbox.map(toolbox.evaluate, invalid_ind)
+        fitnesses = evaluate_invalid(toolbox, invalid_ind)
         for ind, fit in zip(invalid_ind, fitnesses):
             ind.fitness.values = fit
 
-        # Update the hall of fame with the generated individuals, add back elitist
-        offspring.append(elitist)
+        # Update the hall of fame with the generated individuals
         if halloffame is not None:
             halloffame.update(offspring)
 
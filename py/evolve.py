@@ -1,4 +1,5 @@
 import itertools
+import os
 import progressbar
 import random
 import time
@@ -27,9 +28,13 @@ except ModuleNotFoundError as e:
 # ---------------------- Global Variables ---------------------- 
 
 # Global organism evaluator from GeneticShogi python package built from C++
-EVALUATOR = gs.OrganismEvaluator()
+if cfg['train_file']:
+    EVALUATOR = gs.OrganismEvaluator(cfg['train_file'], cfg['test_file'], cfg['moves_file'])
+else:
+    EVALUATOR = gs.OrganismEvaluator()
 EVALUATOR.set_mode(cfg['eval_mode'])
 EVALUATOR.set_num_eval(cfg['n_train'])
+EVALUATOR.set_batch(cfg['batch_size'], cfg['batch_seed'])
 
 # Global encoder / decoder to store bit caches used in gray bit to int conversion
 ENCODER = GrayEncoder(cfg['bit_width_small'], 
@@ -86,6 +91,35 @@ def grandMasterEval(individual):
     return fitness,
 
 
+def grandMasterEvalPopulation(individuals):
+    '''
+    Evaluate a whole generation with one call to the C++ evaluator, which reads the training
+    data once for all individuals instead of once per individual.
+    '''
+    if not individuals:
+        return []
+    weights = [ENCODER.gray_bits_to_weights(individual) for individual in individuals]
+
+    # Print raw weights to command line
+    if cfg['verbose']:
+        for w in weights:
+            print(w)
+
+    # int32 arrays are read and written in place by the evaluator
+    fitness = numpy.zeros(len(weights), dtype=numpy.int32)
+    EVALUATOR.evaluate_population(numpy.array(weights, dtype=numpy.int32), fitness)
+
+    # Must be tuples as specified in DEAP documentation
+    return [(int(f), ) for f in fitness]
+
+
+def newGeneration(gen):
+    '''
+    Draw the mini-batch of positions generation gen is scored on.
+    '''
+    EVALUATOR.set_generation(gen)
+
+
 def init_ga_toolbox():
     '''
     Initialize the DEAP genetic algorithm
@@ -110,6 +144,9 @@ def init_ga_toolbox():
         "evaluate",
         grandMasterEval,
     )
+    toolbox.register("evaluate_population", grandMasterEvalPopulation)
+    if cfg['batch_size'] > 0:
+        toolbox.register("new_generation", newGeneration)
     toolbox.register("mate", tools.cxUniform, indpb=0.4)
     toolbox.register("mutate", tools.mutFlipBit, indpb=0.05)
     toolbox.register("select", tools.selRoulette)
@@ -150,6 +187,60 @@ def evolve(toolbox, log, prog_bar):
     return pop, stats, hof
 
 
+def evolve_native(log, prog_bar):
+    '''
+    Same evolution as evolve() run by the C++ GeneticAlgorithm, one generation per call so the log
+    and progress bar stay up to date. Returns the final population and best individual as bit lists.
+    '''
+    ga_cfg = gs.GAConfig()
+    ga_cfg.pop_size = cfg['pop_size']
+    ga_cfg.cxpb = cfg['cxpb']
+    ga_cfg.mutpb = cfg['mutpb']
+    ga_cfg.bit_width_small = cfg['bit_width_small']
+    ga_cfg.bit_width_wide = cfg['bit_width_wide']
+    ga_cfg.seed = random.randrange(2**32)
+
+    first_gen = 0
+    checkpoint = cfg['checkpoint_file']
+    if checkpoint and os.path.exists(checkpoint):
+        # Resume an interrupted run, population and random state come from the checkpoint
+        if cfg['n_islands'] > 1:
+            ga = gs.IslandModel(EVALUATOR, checkpoint)
+            islands = [ga.get_island(i) for i in range(ga.get_num_islands())]
+        else:
+            ga = gs.GeneticAlgorithm(EVALUATOR, checkpoint)
+            islands = [ga]
+        first_gen = ga.get_generation() + 1
+    elif cfg['n_islands'] > 1:
+        island_cfg = gs.IslandConfig()
+        island_cfg.n_islands = cfg['n_islands']
+        island_cfg.migration_interval = cfg['migration_interval']
+        island_cfg.n_migrants = cfg['n_migrants']
+        island_cfg.topology = cfg['topology']
+        ga = gs.IslandModel(EVALUATOR, ga_cfg, island_cfg)
+        islands = [ga.get_island(i) for i in range(ga.get_num_islands())]
+    else:
+        ga = gs.GeneticAlgorithm(EVALUATOR, ga_cfg)
+        islands = [ga]
+
+    if checkpoint:
+        ga.set_checkpoint(checkpoint, cfg['checkpoint_interval'])
+
+    prog_bar.start()
+    log.log("gen\tisland\tnevals\ttime\tavg\tstd\tmin\tmax")
+    for gen in range(first_gen, cfg['n_gen'] + 1):
+        # The first call also evaluates the initial population
+        for record in ga.run_generations(0 if gen == 0 else 1):
+            log.log("{:.0f}\t{:.0f}\t{:.0f}\t{:.0f}ms\t{}\t{}\t{:.0f}\t{:.0f}".format(
+                record['gen'], record.get('island', 0), record['nevals'], record['time_ms'],
+                record['avg'], record['std'], record['min'], record['max']))
+        prog_bar.update(gen)
+    prog_bar.finish()
+
+    pop = [island.get_genome(i) for island in islands for i in range(island.get_pop_size())]
+    return pop, None, [ga.get_best_genome()]
+
+
 def main():
     '''
     Driver for the evolutionary algorithm, handles parallelization, GA execution
@@ -175,7 +266,10 @@ def main():
     # Run the evolutionary algorithm, close multiprocessing pool when completed.
     print("--------------- Beginning Evolution ---------------")
     start = time.time()
-    pop, stats, hof = evolve(toolbox, logger, bar)
+    if cfg['ga_engine'] == 'native':
+        pop, stats, hof = evolve_native(logger, bar)
+    else:
+        pop, stats, hof = evolve(toolbox, logger, bar)
 
     # Record how long EA took
     end = time.time() - start